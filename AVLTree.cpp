@@ -0,0 +1,562 @@
+/**
+ * @file AVLTree.cpp
+ *
+ * @brief Self-balancing binary search tree (AVL). Every node keeps the height of its subtree and the tree is
+ *        rotated after each insert and erase so the heights of two siblings never differ by more than one.
+ *        The height of the whole tree stays below 1.44 * log2(n), so insert, search and erase are O(log n)
+ *        even when the keys arrive sorted, which turns the plain BinaryTree into a linked list.
+ *
+ *        Every node also keeps the size of its subtree, updated together with the height, so rank, select and
+ *        countInRange are O(log n) as well. BinaryTree in BinaryTreeQueue.cpp has the same queries, but they are
+ *        O(height) there and degrade to O(n) when its keys were inserted in sorted order.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 11:01
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <vector>
+
+template <class T>
+class Node {
+public:
+
+	Node(T value)
+	{
+		this->value = value;
+		this->left = nullptr;
+		this->right = nullptr;
+		this->height = 1;
+		this->size = 1;
+	}
+
+	T value;
+	Node* left;
+	Node* right;
+	int height;
+	std::size_t size; // Amount of nodes in the subtree rooted here
+};
+
+template <class T>
+class AVLTree {
+public:
+	AVLTree();
+	~AVLTree();
+
+	void insert(T key);
+	bool erase(T key);
+	Node<T>* search(T key);
+	int height();
+	std::size_t size() const;
+
+	std::size_t rank(T key) const;
+	Node<T>* select(std::size_t k) const;
+	std::size_t countInRange(T lo, T hi) const;
+
+	template <class Visitor>
+	void rangeScan(T lo, T hi, Visitor visitor) const;
+
+private:
+	Node<T>* insert(T key, Node<T>* leaf);
+	Node<T>* erase(T key, Node<T>* leaf, bool& erased);
+	Node<T>* rebalance(Node<T>* leaf);
+	Node<T>* rotateLeft(Node<T>* leaf);
+	Node<T>* rotateRight(Node<T>* leaf);
+	void destroy(Node<T>* leaf);
+
+	std::size_t countBelow(T key, bool inclusive) const;
+
+	static int height(Node<T>* leaf);
+	static std::size_t size(Node<T>* leaf);
+	static void update(Node<T>* leaf);
+
+	Node<T> *root;
+};
+
+template <class T>
+AVLTree<T>::AVLTree()
+{
+	this->root = nullptr;
+}
+
+template <class T>
+AVLTree<T>::~AVLTree()
+{
+	destroy(root);
+}
+
+template <class T>
+void AVLTree<T>::destroy(Node<T>* leaf)
+{
+	if (leaf != nullptr) {
+		destroy(leaf->left);
+		destroy(leaf->right);
+		delete leaf;
+	}
+}
+
+template <class T>
+int AVLTree<T>::height(Node<T>* leaf)
+{
+	return (leaf != nullptr) ? leaf->height : 0;
+}
+
+template <class T>
+int AVLTree<T>::height()
+{
+	return height(root);
+}
+
+template <class T>
+std::size_t AVLTree<T>::size(Node<T>* leaf)
+{
+	return (leaf != nullptr) ? leaf->size : 0;
+}
+
+template <class T>
+std::size_t AVLTree<T>::size() const
+{
+	return size(root);
+}
+
+/**
+ * Recomputes the height and size of a node from its children. Every node whose children change passes through
+ * here, the rotations included, so the sizes stay right without extra work.
+ */
+template <class T>
+void AVLTree<T>::update(Node<T>* leaf)
+{
+	leaf->height = 1 + std::max(height(leaf->left), height(leaf->right));
+	leaf->size = 1 + size(leaf->left) + size(leaf->right);
+}
+
+/**
+ * Rotates the right child up
+ *
+ *     leaf            right
+ *    /    \          /     \
+ *   a    right  =>  leaf    c
+ *       /     \    /    \
+ *      b       c  a      b
+ *
+ * @return the node that takes the place of leaf
+ */
+template <class T>
+Node<T>* AVLTree<T>::rotateLeft(Node<T>* leaf)
+{
+	Node<T>* right = leaf->right;
+	leaf->right = right->left;
+	right->left = leaf;
+	update(leaf);
+	update(right);
+	return right;
+}
+
+/**
+ * Rotates the left child up
+ *
+ *       leaf        left
+ *      /    \      /    \
+ *    left    c => a     leaf
+ *   /    \             /    \
+ *  a      b           b      c
+ *
+ * @return the node that takes the place of leaf
+ */
+template <class T>
+Node<T>* AVLTree<T>::rotateRight(Node<T>* leaf)
+{
+	Node<T>* left = leaf->left;
+	leaf->left = left->right;
+	left->right = leaf;
+	update(leaf);
+	update(left);
+	return left;
+}
+
+/**
+ * Restores the AVL property of a node whose children differ in height by at most two
+ *
+ * @param leaf the node to rebalance
+ * @return the node that takes its place in the tree
+ */
+template <class T>
+Node<T>* AVLTree<T>::rebalance(Node<T>* leaf)
+{
+	update(leaf);
+	int balance = height(leaf->left) - height(leaf->right);
+
+	if (balance > 1) { // Left side is too tall
+		if (height(leaf->left->left) < height(leaf->left->right)) { // Left-right case
+			leaf->left = rotateLeft(leaf->left);
+		}
+		return rotateRight(leaf);
+	}
+
+	if (balance < -1) { // Right side is too tall
+		if (height(leaf->right->right) < height(leaf->right->left)) { // Right-left case
+			leaf->right = rotateRight(leaf->right);
+		}
+		return rotateLeft(leaf);
+	}
+
+	return leaf;
+}
+
+// Recursive, the depth is bounded by the height of the tree
+template <class T>
+Node<T>* AVLTree<T>::insert(T key, Node<T>* leaf)
+{
+	if (leaf == nullptr) {
+		return new Node<T>(key);
+	}
+
+	if (key < leaf->value) {
+		leaf->left = insert(key, leaf->left);
+	} else {
+		leaf->right = insert(key, leaf->right);
+	}
+
+	return rebalance(leaf);
+}
+
+template <class T>
+void AVLTree<T>::insert(T key)
+{
+	root = insert(key, root);
+}
+
+// Recursive, the depth is bounded by the height of the tree
+template <class T>
+Node<T>* AVLTree<T>::erase(T key, Node<T>* leaf, bool& erased)
+{
+	if (leaf == nullptr) {
+		return nullptr;
+	}
+
+	if (key < leaf->value) {
+		leaf->left = erase(key, leaf->left, erased);
+	} else if (leaf->value < key) {
+		leaf->right = erase(key, leaf->right, erased);
+	} else {
+		erased = true;
+
+		if (leaf->left == nullptr || leaf->right == nullptr) { // Zero or one child, the child takes its place
+			Node<T>* child = (leaf->left != nullptr) ? leaf->left : leaf->right;
+			delete leaf;
+			return child;
+		}
+
+		// Two children, take over the smallest value of the right subtree and erase that node instead
+		Node<T>* successor = leaf->right;
+		while (successor->left != nullptr) {
+			successor = successor->left;
+		}
+
+		leaf->value = successor->value;
+		bool ignored = false;
+		leaf->right = erase(successor->value, leaf->right, ignored);
+	}
+
+	return rebalance(leaf);
+}
+
+template <class T>
+bool AVLTree<T>::erase(T key)
+{
+	bool erased = false;
+	root = erase(key, root, erased);
+	return erased;
+}
+
+template <class T>
+Node<T>* AVLTree<T>::search(T key)
+{
+	Node<T>* leaf = root;
+
+	while (leaf != nullptr && !(key == leaf->value)) {
+		leaf = (key < leaf->value) ? leaf->left : leaf->right;
+	}
+
+	return leaf;
+}
+
+/**
+ * Counts the keys below key, or below and equal to key, by adding up the left subtree sizes of the nodes where
+ * the search turns right. O(log n) as the tree stays balanced.
+ */
+template <class T>
+std::size_t AVLTree<T>::countBelow(T key, bool inclusive) const
+{
+	std::size_t count = 0;
+	Node<T>* leaf = root;
+
+	while (leaf != nullptr) {
+		bool goRight = inclusive ? !(key < leaf->value) : (leaf->value < key);
+		if (goRight) {
+			count += 1 + size(leaf->left);
+			leaf = leaf->right;
+		} else {
+			leaf = leaf->left;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Amount of keys smaller than key, i.e. the position key has or would have in sorted order. O(log n).
+ */
+template <class T>
+std::size_t AVLTree<T>::rank(T key) const
+{
+	return countBelow(key, false);
+}
+
+/**
+ * Finds the k:th smallest key, counting from 0. O(log n).
+ *
+ * @return the node or nullptr if the tree has k or fewer keys
+ */
+template <class T>
+Node<T>* AVLTree<T>::select(std::size_t k) const
+{
+	Node<T>* leaf = root;
+
+	while (leaf != nullptr) {
+		std::size_t leftSize = size(leaf->left);
+		if (k < leftSize) {
+			leaf = leaf->left;
+		} else if (k == leftSize) {
+			return leaf;
+		} else {
+			k -= leftSize + 1;
+			leaf = leaf->right;
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+ * Amount of keys from lo to hi (inclusive). O(log n).
+ */
+template <class T>
+std::size_t AVLTree<T>::countInRange(T lo, T hi) const
+{
+	if (hi < lo) {
+		return 0;
+	}
+
+	return countBelow(hi, true) - countBelow(lo, false);
+}
+
+/**
+ * Visits the keys from lo to hi (inclusive) in order. Subtrees that lie completely outside the range are never
+ * entered, so the cost is O(log n + keys visited).
+ *
+ * @param visitor is called with every key in the range
+ */
+template <class T>
+template <class Visitor>
+void AVLTree<T>::rangeScan(T lo, T hi, Visitor visitor) const
+{
+	std::vector<Node<T>*> stack;
+	Node<T>* leaf = root;
+
+	while (leaf != nullptr || !stack.empty()) {
+		while (leaf != nullptr) {
+			if (leaf->value < lo) { // The node and its left subtree are below the range
+				leaf = leaf->right;
+			} else {
+				stack.push_back(leaf);
+				leaf = leaf->left;
+			}
+		}
+
+		if (stack.empty()) {
+			break;
+		}
+
+		leaf = stack.back();
+		stack.pop_back();
+		if (hi < leaf->value) { // Everything after this node is above the range
+			break;
+		}
+
+		visitor(leaf->value);
+		leaf = leaf->right;
+	}
+}
+
+/**
+ * The unbalanced tree from BinaryTreeQueue.cpp, used as the baseline in the benchmark
+ */
+template <class T>
+class BinaryTree {
+public:
+	BinaryTree() { this->root = nullptr; }
+
+	~BinaryTree() {
+		std::vector<Node<T>*> pending;
+		if (root != nullptr) {
+			pending.push_back(root);
+		}
+
+		while (!pending.empty()) { // Not recursive, the degenerate trees are as deep as they are long
+			Node<T>* leaf = pending.back();
+			pending.pop_back();
+			if (leaf->left != nullptr) {
+				pending.push_back(leaf->left);
+			}
+			if (leaf->right != nullptr) {
+				pending.push_back(leaf->right);
+			}
+			delete leaf;
+		}
+	}
+
+	void insert(T key) {
+		if (root == nullptr) {
+			root = new Node<T>(key);
+			return;
+		}
+
+		Node<T>* leaf = root;
+		for (;;) {
+			Node<T>*& child = (key < leaf->value) ? leaf->left : leaf->right;
+			if (child == nullptr) {
+				child = new Node<T>(key);
+				return;
+			}
+			leaf = child;
+		}
+	}
+
+	Node<T>* search(T key) {
+		Node<T>* leaf = root;
+		while (leaf != nullptr && !(key == leaf->value)) {
+			leaf = (key < leaf->value) ? leaf->left : leaf->right;
+		}
+		return leaf;
+	}
+
+private:
+	Node<T> *root;
+};
+
+/**
+ * Inserts keys in the given order and then searches all of them
+ */
+template <class Tree>
+void benchmark(const char* name, const std::vector<int>& keys)
+{
+	Tree tree;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int key : keys) {
+		tree.insert(key);
+	}
+	std::chrono::duration<double, std::milli> insertTime = std::chrono::steady_clock::now() - start;
+
+	int found = 0;
+	start = std::chrono::steady_clock::now();
+	for (int key : keys) {
+		found += (tree.search(key) != nullptr);
+	}
+	std::chrono::duration<double, std::milli> searchTime = std::chrono::steady_clock::now() - start;
+
+	std::cout << name << "insert " << insertTime.count() << " ms, search " << searchTime.count() << " ms"
+		<< (found == (int)keys.size() ? "" : " (keys missing!)") << "\n";
+}
+
+/**
+ * Inserts keys in the given order and then asks for the rank of every key and selects every rank. The keys are
+ * 0 to n - 1, so the rank of a key is the key itself.
+ */
+void benchmarkOrderStatistics(const char* name, const std::vector<int>& keys)
+{
+	AVLTree<int> tree;
+	for (int key : keys) {
+		tree.insert(key);
+	}
+
+	int wrong = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int key : keys) {
+		wrong += (tree.rank(key) != (std::size_t)key);
+	}
+	for (std::size_t k = 0; k < keys.size(); k++) {
+		wrong += (tree.select(k)->value != (int)k);
+	}
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::cout << name << elapsed.count() / (2 * keys.size()) << " ns per rank or select, height " << tree.height()
+		<< (wrong == 0 ? "" : " (wrong answers!)") << "\n";
+}
+
+int main()
+{
+	AVLTree<int> avlTree;
+
+	avlTree.insert(10);
+	avlTree.insert(9);
+	avlTree.insert(8);
+	avlTree.insert(7);
+	avlTree.insert(6);
+	avlTree.insert(5);
+	avlTree.insert(4);
+	avlTree.insert(3);
+	avlTree.insert(2);
+	avlTree.insert(1);
+
+	std::cout << "Height after inserting 10 down to 1: " << avlTree.height() << "\n"; // 4 instead of 10
+
+	Node<int>* getNode = avlTree.search(5);
+	std::cout << getNode->value << "\n"; // 5
+
+	avlTree.erase(5);
+	std::cout << (avlTree.search(5) == nullptr ? "5 was erased" : "5 is still there") << "\n";
+
+	std::cout << "Rank of 7: " << avlTree.rank(7) << "\n";                    // 5
+	std::cout << "Key with rank 4: " << avlTree.select(4)->value << "\n";     // 6
+	std::cout << "Keys from 3 to 8: " << avlTree.countInRange(3, 8) << "\n";  // 5
+
+	avlTree.rangeScan(3, 8, [](int key) { std::cout << key << " "; });      // 3 4 6 7 8
+	std::cout << "\n";
+
+	// The unbalanced tree needs O(n^2) for the sorted orders, so n is kept small enough for it to finish
+	const int n = 20000;
+	std::vector<int> sorted(n);
+	for (int i = 0; i < n; i++) {
+		sorted[i] = i;
+	}
+
+	std::vector<int> reversed(sorted.rbegin(), sorted.rend());
+	std::vector<int> random = sorted;
+	std::shuffle(random.begin(), random.end(), std::mt19937(42));
+
+	std::cout << "Sorted keys:\n";
+	benchmark<BinaryTree<int>>("  BinaryTree: ", sorted);
+	benchmark<AVLTree<int>>("  AVLTree:    ", sorted);
+
+	std::cout << "Reverse-sorted keys:\n";
+	benchmark<BinaryTree<int>>("  BinaryTree: ", reversed);
+	benchmark<AVLTree<int>>("  AVLTree:    ", reversed);
+
+	std::cout << "Random keys:\n";
+	benchmark<BinaryTree<int>>("  BinaryTree: ", random);
+	benchmark<AVLTree<int>>("  AVLTree:    ", random);
+
+	std::cout << "Order statistics on the AVLTree:\n";
+	benchmarkOrderStatistics("  Sorted keys:  ", sorted);
+	benchmarkOrderStatistics("  Reverse keys: ", reversed);
+	benchmarkOrderStatistics("  Random keys:  ", random);
+
+	return 0;
+}
@@ -0,0 +1,515 @@
+/**
+ * @file BPlusTree.cpp
+ *
+ * @brief B+tree set whose node keys fill exactly one cache line (16 keys for int). The keys are compared against
+ *        the search key all at once with SIMD instructions, so a lookup reads one line of keys per level instead of
+ *        one key per level like in a binary tree. Only the keys are a cache line: count, the leaf flag and the
+ *        next pointer (leaves) or the 17 child pointers (inner nodes) follow on the next lines, so a leaf spans two
+ *        cache lines and an inner node four, and descending reads the key line plus the line with the child pointer.
+ *        All keys live in the leaves, and the leaves are linked together so range scans just walk the leaf chain.
+ *
+ *        An inner node stores as separator the largest key of each child except the last one, so both the leaves
+ *        and the inner nodes are searched with the same lower bound (amount of keys smaller than the search key).
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 11:01
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+constexpr int cacheLineSize = 64;
+
+/**
+ * Amount of keys that fit in one cache line
+ */
+template <class T>
+constexpr int keysPerNode = cacheLineSize / sizeof(T);
+
+/**
+ * Amount of keys smaller than key among the first count keys. Unused keys hold the largest value of T.
+ */
+template <class T>
+int lowerBound(const T* keys, int count, T key)
+{
+	int i = 0;
+	while (i < count && keys[i] < key) {
+		i++;
+	}
+
+	return i;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+/**
+ * SIMD version for int. All 16 keys of the node are compared at once and the matches are counted. The unused
+ * keys hold INT_MAX, which is never smaller than the search key, so count is not needed.
+ */
+template <>
+int lowerBound<int>(const int* keys, int, int key)
+{
+#ifdef __AVX2__
+	__m256i needle = _mm256_set1_epi32(key);
+	__m256i low = _mm256_cmpgt_epi32(needle, _mm256_load_si256(reinterpret_cast<const __m256i*>(keys)));
+	__m256i high = _mm256_cmpgt_epi32(needle, _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + 8)));
+	int mask = _mm256_movemask_ps(_mm256_castsi256_ps(low)) | (_mm256_movemask_ps(_mm256_castsi256_ps(high)) << 8);
+#else
+	__m128i needle = _mm_set1_epi32(key);
+	int mask = 0;
+	for (int i = 0; i < 4; i++) {
+		__m128i block = _mm_load_si128(reinterpret_cast<const __m128i*>(keys + 4 * i));
+		mask |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(block, needle))) << (4 * i);
+	}
+#endif
+	return __builtin_popcount(mask);
+}
+#endif
+
+template <class T>
+class BNode {
+public:
+	BNode(bool leaf)
+	{
+		std::fill(keys, keys + keysPerNode<T>, std::numeric_limits<T>::max());
+		this->count = 0;
+		this->leaf = leaf;
+	}
+
+	alignas(cacheLineSize) T keys[keysPerNode<T>]; // One cache line, the rest of the node follows it
+	int count;
+	bool leaf;
+};
+
+template <class T>
+class BLeaf : public BNode<T> {
+public:
+	BLeaf() : BNode<T>(true) { this->next = nullptr; }
+
+	BLeaf* next; // The leaf with the next larger keys
+};
+
+template <class T>
+class BInner : public BNode<T> {
+public:
+	BInner() : BNode<T>(false) {}
+
+	BNode<T>* children[keysPerNode<T> + 1]; // count + 1 children
+};
+
+template <class T>
+class BPlusTree {
+public:
+	static constexpr int order = keysPerNode<T>;
+
+	BPlusTree();
+	~BPlusTree();
+
+	BPlusTree(const BPlusTree&) = delete;
+	BPlusTree& operator=(const BPlusTree&) = delete;
+
+	bool insert(T key);
+	bool search(T key) const;
+
+	template <class Visitor>
+	void rangeScan(T lo, T hi, Visitor visitor) const;
+
+	int height() const;
+
+private:
+	bool insert(BNode<T>* node, T key, T& separator, BNode<T>*& right);
+	bool insertIntoLeaf(BLeaf<T>* leaf, T key, T& separator, BNode<T>*& right);
+	const BLeaf<T>* findLeaf(T key) const;
+	void destroy(BNode<T>* node);
+
+	BNode<T>* root;
+};
+
+template <class T>
+BPlusTree<T>::BPlusTree()
+{
+	this->root = new BLeaf<T>();
+}
+
+template <class T>
+BPlusTree<T>::~BPlusTree()
+{
+	destroy(root);
+}
+
+template <class T>
+void BPlusTree<T>::destroy(BNode<T>* node)
+{
+	if (node->leaf) {
+		delete static_cast<BLeaf<T>*>(node);
+		return;
+	}
+
+	BInner<T>* inner = static_cast<BInner<T>*>(node);
+	for (int i = 0; i <= inner->count; i++) {
+		destroy(inner->children[i]);
+	}
+	delete inner;
+}
+
+/**
+ * Walks down to the leaf that holds key, if the key is in the tree
+ */
+template <class T>
+const BLeaf<T>* BPlusTree<T>::findLeaf(T key) const
+{
+	const BNode<T>* node = root;
+
+	while (!node->leaf) {
+		const BInner<T>* inner = static_cast<const BInner<T>*>(node);
+		node = inner->children[lowerBound(inner->keys, inner->count, key)];
+	}
+
+	return static_cast<const BLeaf<T>*>(node);
+}
+
+template <class T>
+bool BPlusTree<T>::search(T key) const
+{
+	const BLeaf<T>* leaf = findLeaf(key);
+	int i = lowerBound(leaf->keys, leaf->count, key);
+
+	return i < leaf->count && leaf->keys[i] == key;
+}
+
+/**
+ * Inserts key into a leaf, splitting the leaf in two halves first if it is full
+ *
+ * @param separator is set to the largest key of the left half when the leaf was split
+ * @param right is set to the new right half when the leaf was split, otherwise nullptr
+ * @return true if the key was inserted, false if it was already in the tree
+ */
+template <class T>
+bool BPlusTree<T>::insertIntoLeaf(BLeaf<T>* leaf, T key, T& separator, BNode<T>*& right)
+{
+	int pos = lowerBound(leaf->keys, leaf->count, key);
+	if (pos < leaf->count && leaf->keys[pos] == key) {
+		return false;
+	}
+
+	if (leaf->count == order) {
+		const int half = order / 2;
+		BLeaf<T>* sibling = new BLeaf<T>();
+
+		std::copy(leaf->keys + half, leaf->keys + order, sibling->keys);
+		std::fill(leaf->keys + half, leaf->keys + order, std::numeric_limits<T>::max());
+		sibling->count = order - half;
+		leaf->count = half;
+
+		sibling->next = leaf->next;
+		leaf->next = sibling;
+
+		separator = leaf->keys[half - 1];
+		right = sibling;
+
+		if (pos >= half) { // The key is larger than the separator
+			leaf = sibling;
+			pos -= half;
+		}
+	}
+
+	std::copy_backward(leaf->keys + pos, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+	leaf->keys[pos] = key;
+	leaf->count++;
+	return true;
+}
+
+// Recursive, the depth is the height of the tree
+template <class T>
+bool BPlusTree<T>::insert(BNode<T>* node, T key, T& separator, BNode<T>*& right)
+{
+	right = nullptr;
+
+	if (node->leaf) {
+		return insertIntoLeaf(static_cast<BLeaf<T>*>(node), key, separator, right);
+	}
+
+	BInner<T>* inner = static_cast<BInner<T>*>(node);
+	int pos = lowerBound(inner->keys, inner->count, key);
+
+	T childSeparator;
+	BNode<T>* childRight;
+	if (!insert(inner->children[pos], key, childSeparator, childRight)) {
+		return false;
+	}
+
+	if (childRight == nullptr) {
+		return true;
+	}
+
+	// The child was split, childSeparator and childRight go in after child pos
+	if (inner->count == order) {
+		const int mid = order / 2;
+		BInner<T>* sibling = new BInner<T>();
+
+		// keys[mid] moves up, the left half keeps children 0..mid and the right half gets the rest
+		std::copy(inner->keys + mid + 1, inner->keys + order, sibling->keys);
+		std::copy(inner->children + mid + 1, inner->children + order + 1, sibling->children);
+		sibling->count = order - mid - 1;
+
+		separator = inner->keys[mid];
+		right = sibling;
+
+		std::fill(inner->keys + mid, inner->keys + order, std::numeric_limits<T>::max());
+		inner->count = mid;
+
+		if (pos > mid) {
+			inner = sibling;
+			pos -= mid + 1;
+		}
+	}
+
+	std::copy_backward(inner->keys + pos, inner->keys + inner->count, inner->keys + inner->count + 1);
+	std::copy_backward(inner->children + pos + 1, inner->children + inner->count + 1, inner->children + inner->count + 2);
+	inner->keys[pos] = childSeparator;
+	inner->children[pos + 1] = childRight;
+	inner->count++;
+	return true;
+}
+
+/**
+ * Inserts key into the tree. The tree grows a new root when the old root is split.
+ *
+ * @param key to insert
+ * @return true if the key was inserted, false if it was already in the tree
+ */
+template <class T>
+bool BPlusTree<T>::insert(T key)
+{
+	T separator;
+	BNode<T>* right;
+
+	if (!insert(root, key, separator, right)) {
+		return false;
+	}
+
+	if (right != nullptr) {
+		BInner<T>* newRoot = new BInner<T>();
+		newRoot->keys[0] = separator;
+		newRoot->children[0] = root;
+		newRoot->children[1] = right;
+		newRoot->count = 1;
+		root = newRoot;
+	}
+
+	return true;
+}
+
+/**
+ * Visits all keys from lo to hi (inclusive) in order, by walking the leaf chain
+ *
+ * @param lo the smallest key to visit
+ * @param hi the largest key to visit
+ * @param visitor is called with every key in the range
+ */
+template <class T>
+template <class Visitor>
+void BPlusTree<T>::rangeScan(T lo, T hi, Visitor visitor) const
+{
+	const BLeaf<T>* leaf = findLeaf(lo);
+	int i = lowerBound(leaf->keys, leaf->count, lo);
+
+	while (leaf != nullptr) {
+		for (; i < leaf->count; i++) {
+			if (hi < leaf->keys[i]) {
+				return;
+			}
+			visitor(leaf->keys[i]);
+		}
+
+		leaf = leaf->next;
+		i = 0;
+	}
+}
+
+template <class T>
+int BPlusTree<T>::height() const
+{
+	int levels = 1;
+	for (const BNode<T>* node = root; !node->leaf; node = static_cast<const BInner<T>*>(node)->children[0]) {
+		levels++;
+	}
+
+	return levels;
+}
+
+template <class T>
+class Node {
+public:
+	T value;
+	Node* left;
+	Node* right;
+};
+
+/**
+ * The BinaryTree from BinaryTreeQueue.cpp reduced to what the benchmark needs, with its nodes kept together
+ * like its NodePool does
+ */
+template <class T>
+class BinaryTree {
+public:
+	BinaryTree() { this->root = nullptr; }
+
+	void insert(T key) {
+		Node<T>** link = &root;
+		while (*link != nullptr) {
+			link = (key < (*link)->value) ? &(*link)->left : &(*link)->right;
+		}
+		nodes.push_back(Node<T>{ key, nullptr, nullptr });
+		*link = &nodes.back();
+	}
+
+	Node<T>* search(T key) {
+		Node<T>* leaf = root;
+		while (leaf != nullptr && !(key == leaf->value)) {
+			leaf = (key < leaf->value) ? leaf->left : leaf->right;
+		}
+		return leaf;
+	}
+
+private:
+	Node<T> *root;
+	std::deque<Node<T>> nodes;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/**
+ * Inserts n random keys in each structure, then looks up n keys (half of them present) and scans 1000 ranges of
+ * 1000 keys
+ */
+void benchmark(int n)
+{
+	std::mt19937 random(42);
+	std::vector<int> keys(n);
+	for (int& key : keys) {
+		key = random() & 0x7fffffff;
+	}
+
+	std::vector<int> lookups(n);
+	for (int i = 0; i < n; i++) {
+		lookups[i] = (i & 1) ? keys[random() % n] : (int)(random() & 0x7fffffff);
+	}
+
+	const int scans = 1000;
+	const int span = 1000 * (0x7fffffff / n); // Roughly 1000 keys per range
+	const int maxLo = std::numeric_limits<int>::max() - span; // Ranges starting above this end at the largest int
+
+	BPlusTree<int> bPlusTree;
+	BinaryTree<int> binaryTree;
+	std::map<int, int> map;
+	long long found[3] = { 0, 0, 0 };
+
+	std::cout << n << " keys:\n";
+
+	auto start = Clock::now();
+	for (int key : keys) {
+		bPlusTree.insert(key);
+	}
+	double insertTime = millisecondsSince(start);
+
+	start = Clock::now();
+	for (int key : lookups) {
+		found[0] += bPlusTree.search(key);
+	}
+	double searchTime = millisecondsSince(start);
+
+	start = Clock::now();
+	long long scanned = 0;
+	for (int i = 0; i < scans; i++) {
+		int lo = keys[i];
+		bPlusTree.rangeScan(lo, lo > maxLo ? std::numeric_limits<int>::max() : lo + span, [&](int) { scanned++; });
+	}
+	double scanTime = millisecondsSince(start);
+
+	std::cout << "  BPlusTree:  insert " << insertTime << " ms, search " << searchTime << " ms, scan " << scanTime
+		<< " ms (" << scanned << " keys, height " << bPlusTree.height() << ")\n";
+
+	start = Clock::now();
+	for (int key : keys) {
+		binaryTree.insert(key);
+	}
+	insertTime = millisecondsSince(start);
+
+	start = Clock::now();
+	for (int key : lookups) {
+		found[1] += (binaryTree.search(key) != nullptr);
+	}
+	searchTime = millisecondsSince(start);
+
+	std::cout << "  BinaryTree: insert " << insertTime << " ms, search " << searchTime << " ms, no range scan\n";
+
+	start = Clock::now();
+	for (int key : keys) {
+		map.emplace(key, key);
+	}
+	insertTime = millisecondsSince(start);
+
+	start = Clock::now();
+	for (int key : lookups) {
+		found[2] += (map.find(key) != map.end());
+	}
+	searchTime = millisecondsSince(start);
+
+	start = Clock::now();
+	scanned = 0;
+	for (int i = 0; i < scans; i++) {
+		int lo = keys[i];
+		int hi = lo > maxLo ? std::numeric_limits<int>::max() : lo + span;
+		for (auto it = map.lower_bound(lo); it != map.end() && it->first <= hi; ++it) {
+			scanned++;
+		}
+	}
+	scanTime = millisecondsSince(start);
+
+	std::cout << "  std::map:   insert " << insertTime << " ms, search " << searchTime << " ms, scan " << scanTime
+		<< " ms (" << scanned << " keys)\n";
+
+	if (found[0] != found[1] || found[0] != found[2]) {
+		std::cout << "  Search results differ!\n";
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	BPlusTree<int> bPlusTree;
+
+	for (int i = 100; i >= 1; i--) {
+		bPlusTree.insert(i);
+	}
+
+	std::cout << "Height after inserting 100 down to 1: " << bPlusTree.height() << "\n"; // 2
+	std::cout << (bPlusTree.search(42) ? "42 found" : "42 missing") << "\n";
+
+	bPlusTree.rangeScan(10, 20, [](int key) { std::cout << key << " "; }); // 10 11 ... 20
+	std::cout << "\n";
+
+	// Pass the largest size to benchmark, e.g. 100000000 (needs around 10 GB). The default keeps the run short.
+	int largest = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+	for (int n = 1000000; n <= largest; n *= 10) {
+		benchmark(n);
+	}
+
+	return 0;
+}
@@ -8,7 +8,24 @@
  * @date 2020-04-13 11:01
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 template <class T>
 class Node {
@@ -21,86 +38,1548 @@ public:
 		this->value = value;
 		this->left = nullptr;
 		this->right = nullptr;
+		this->size = 1;
 	}
 
 	T value;
 	Node* left;
 	Node* right;
+	std::size_t size; // Amount of nodes in the subtree rooted here
 };
 
+/**
+ * Block of nodes owned by a NodePool
+ */
+template <class T>
+class NodeChunk {
+public:
+	Node<T>* nodes;
+	std::size_t capacity;
+};
+
+/**
+ * Hands out tree nodes from large chunks instead of allocating them one by one. Erased nodes are kept on a
+ * free list and handed out again. All nodes are freed together, one delete per chunk.
+ */
+template <class T>
+class NodePool {
+public:
+	NodePool(std::size_t chunkSize = 1024)
+	{
+		this->chunkSize = chunkSize;
+		this->chunk = 0;
+		this->used = 0;
+		this->freeList = nullptr;
+	}
+
+	~NodePool()
+	{
+		for (NodeChunk<T>& c : chunks) {
+			delete[] c.nodes;
+		}
+	}
+
+	NodePool(const NodePool&) = delete;
+	NodePool& operator=(const NodePool&) = delete;
+
+	Node<T>* allocate(T key);
+	Node<T>* allocateBlock(std::size_t count);
+	void release(Node<T>* node);
+	void reset();
+
+private:
+	std::vector<NodeChunk<T>> chunks;
+	std::size_t chunkSize;
+	std::size_t chunk; // Chunk that nodes are currently handed out from
+	std::size_t used;  // Amount of nodes handed out from that chunk
+	Node<T>* freeList; // Released nodes, linked through their left pointer
+};
+
+/**
+ * Gets a node for key, re-using a released node if there is any
+ *
+ * @param key the value of the node
+ * @return a node without children
+ */
+template <class T>
+Node<T>* NodePool<T>::allocate(T key)
+{
+	Node<T>* node;
+
+	if (freeList != nullptr) {
+		node = freeList;
+		freeList = freeList->left;
+	} else {
+		if (chunk < chunks.size() && used == chunks[chunk].capacity) {
+			chunk++;
+			used = 0;
+		}
+		if (chunk == chunks.size()) { // Only allocate when there is no chunk left from before a reset()
+			chunks.push_back(NodeChunk<T>{ new Node<T>[chunkSize], chunkSize });
+		}
+		node = &chunks[chunk].nodes[used++];
+	}
+
+	node->value = key;
+	node->left = nullptr;
+	node->right = nullptr;
+	node->size = 1;
+	return node;
+}
+
+/**
+ * Gets count nodes that lie next to each other in memory. The nodes are not initialized.
+ *
+ * @param count the amount of nodes
+ * @return the first of the nodes
+ */
+template <class T>
+Node<T>* NodePool<T>::allocateBlock(std::size_t count)
+{
+	if (chunk < chunks.size() && chunks[chunk].capacity - used >= count) {
+		Node<T>* nodes = chunks[chunk].nodes + used;
+		used += count;
+		return nodes;
+	}
+
+	// Does not fit, put a chunk of its own in front of the chunks that have not been used yet
+	std::size_t position = (chunk < chunks.size() && used > 0) ? chunk + 1 : chunk;
+	std::size_t capacity = (count > chunkSize) ? count : chunkSize;
+
+	chunks.insert(chunks.begin() + position, NodeChunk<T>{ new Node<T>[capacity], capacity });
+	chunk = position;
+	used = count;
+	return chunks[chunk].nodes;
+}
+
+/**
+ * Puts a node that is no longer in the tree on the free list
+ */
+template <class T>
+void NodePool<T>::release(Node<T>* node)
+{
+	node->left = freeList;
+	freeList = node;
+}
+
+/**
+ * Forgets every node that has been handed out, but keeps the chunks so they can be filled again
+ */
+template <class T>
+void NodePool<T>::reset()
+{
+	chunk = 0;
+	used = 0;
+	freeList = nullptr;
+}
+
+/**
+ * Branchless search in keys laid out in Eytzinger order (see EytzingerTree), shared by the in-memory index and
+ * the memory-mapped file
+ *
+ * @param keys the keys, keys[0] is not used
+ * @param n amount of keys
+ * @param inclusive true to find the first key not less than key, false for the first key greater than key
+ * @return the position of the key found, or 0 if there is none
+ */
+template <class T>
+std::size_t eytzingerBound(const T* keys, std::size_t n, const T& key, bool inclusive)
+{
+	std::size_t k = 1;
+
+	while (k <= n) {
+		__builtin_prefetch(keys + 4 * k); // The four grandchildren are next to each other
+		k = 2 * k + (inclusive ? (keys[k] < key) : !(key < keys[k]));
+	}
+
+	// Every right turn after the last left turn went past the answer, undo them and the left turn
+	return k >> __builtin_ffsll(~k);
+}
+
+/**
+ * Position of the smallest key in an Eytzinger layout of n keys: the leftmost node
+ */
+inline std::size_t eytzingerFirst(std::size_t n)
+{
+	std::size_t k = 1;
+	while (2 * k <= n) {
+		k = 2 * k;
+	}
+	return (n == 0) ? 0 : k;
+}
+
+/**
+ * Position of the next larger key after position k, i.e. the in-order successor in the implicit tree
+ *
+ * @return the position, or 0 after the largest key
+ */
+inline std::size_t eytzingerNext(std::size_t k, std::size_t n)
+{
+	if (2 * k + 1 <= n) { // Leftmost node of the right subtree
+		k = 2 * k + 1;
+		while (2 * k <= n) {
+			k = 2 * k;
+		}
+		return k;
+	}
+
+	while (k & 1) { // Climb out of right subtrees, then up once more from the left child
+		k >>= 1;
+	}
+	return k >> 1;
+}
+
+/**
+ * Read-only search index in Eytzinger (BFS) order: the root is keys[1] and the children of keys[k] are
+ * keys[2k] and keys[2k + 1]. There are no pointers, so it needs a fraction of the memory of the tree, and the
+ * top levels that every search visits share a few cache lines. The search loop has no unpredictable branch
+ * and prefetches the four grandchildren of the current key while comparing it.
+ */
+template <class T>
+class EytzingerTree {
+public:
+	EytzingerTree(const std::vector<T>& sorted);
+
+	const T* search(T key) const;
+	const T* lowerBound(T key) const;
+	const T* upperBound(T key) const;
+	std::size_t size() const;
+
+private:
+	std::size_t fill(const std::vector<T>& sorted, std::size_t i, std::size_t k);
+
+	std::vector<T> keys; // keys[0] is not used
+};
+
+/**
+ * Builds the index from sorted keys
+ *
+ * @param sorted the keys in ascending order
+ */
+template <class T>
+EytzingerTree<T>::EytzingerTree(const std::vector<T>& sorted)
+{
+	keys.resize(sorted.size() + 1);
+	fill(sorted, 0, 1);
+}
+
+/**
+ * Places the sorted keys by walking the implicit tree in order (recursive, the depth is log2(n))
+ *
+ * @param i the next sorted key to place
+ * @param k the position in the implicit tree
+ * @return the next sorted key to place after the subtree at k
+ */
+template <class T>
+std::size_t EytzingerTree<T>::fill(const std::vector<T>& sorted, std::size_t i, std::size_t k)
+{
+	if (k < keys.size()) {
+		i = fill(sorted, i, 2 * k);
+		keys[k] = sorted[i++];
+		i = fill(sorted, i, 2 * k + 1);
+	}
+
+	return i;
+}
+
+/**
+ * Finds the smallest key that is not less than key
+ *
+ * @return a pointer to that key or nullptr if every key is less than key
+ */
+template <class T>
+const T* EytzingerTree<T>::lowerBound(T key) const
+{
+	std::size_t k = eytzingerBound(keys.data(), size(), key, true);
+	return (k == 0) ? nullptr : &keys[k];
+}
+
+/**
+ * Finds the smallest key that is greater than key
+ *
+ * @return a pointer to that key or nullptr if no key is greater than key
+ */
+template <class T>
+const T* EytzingerTree<T>::upperBound(T key) const
+{
+	std::size_t k = eytzingerBound(keys.data(), size(), key, false);
+	return (k == 0) ? nullptr : &keys[k];
+}
+
+/**
+ * Finds key
+ *
+ * @return a pointer to the key or nullptr if it is not in the index
+ */
+template <class T>
+const T* EytzingerTree<T>::search(T key) const
+{
+	const T* found = lowerBound(key);
+	return (found != nullptr && *found == key) ? found : nullptr;
+}
+
+template <class T>
+std::size_t EytzingerTree<T>::size() const
+{
+	return keys.size() - 1;
+}
+
+constexpr std::uint32_t treeFileMagic = 0x45455254; // "TREE"
+constexpr std::uint32_t treeFileVersion = 1;
+constexpr std::uint64_t treeFileDataOffset = 64;   // The keys start on their own cache line
+
+/**
+ * Fixed layout at the start of a tree file. It is followed, at dataOffset, by count + 1 keys in Eytzinger order
+ * exactly as EytzingerTree keeps them in memory (the first one is not used), so the file can be searched where
+ * it is mapped. Keys are stored in the byte order of the machine that wrote them.
+ */
+class TreeFileHeader {
+public:
+	std::uint32_t magic;       // Written last, a file that was not finished does not have it
+	std::uint32_t version;
+	std::uint64_t keySize;     // sizeof(T) of the writer
+	std::uint64_t count;       // Amount of keys
+	std::uint64_t dataOffset;
+	std::uint64_t checksum;    // FNV-1a over the bytes of the keys
+};
+
+/**
+ * 64-bit FNV-1a hash, used as the checksum of tree files
+ */
+inline std::uint64_t checksumOf(const unsigned char* data, std::size_t length)
+{
+	std::uint64_t hash = 14695981039346656037ull;
+	for (std::size_t i = 0; i < length; i++) {
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+/**
+ * Flushes the directory that holds path, so that a file renamed into it is still there after a crash
+ *
+ * @return true if the directory was flushed
+ */
+inline bool syncDirectoryOf(const std::string& path)
+{
+	std::size_t slash = path.find_last_of('/');
+	std::string directory = (slash == std::string::npos) ? "." : (slash == 0) ? "/" : path.substr(0, slash);
+
+	int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+	if (fd == -1) {
+		return false;
+	}
+
+	bool synced = fsync(fd) == 0;
+	close(fd);
+	return synced;
+}
+
+/**
+ * Writes a tree file from keys that arrive one by one in ascending order. The amount of keys has to be known
+ * up front; every key goes straight to its final place in the mapped file, so nothing is buffered. The file is
+ * written under a temporary name and renamed over path by finish(), so readers never see half a file.
+ */
+template <class T>
+class TreeFileWriter {
+	static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable keys can be stored in a file");
+
+public:
+	TreeFileWriter(const char* path, std::uint64_t count);
+	~TreeFileWriter();
+
+	TreeFileWriter(const TreeFileWriter&) = delete;
+	TreeFileWriter& operator=(const TreeFileWriter&) = delete;
+
+	bool isOpen() const;
+	void write(const T& key);
+	bool finish();
+
+private:
+	std::string path;
+	std::string temporaryPath;
+	TreeFileHeader* header;
+	T* keys;
+	std::uint64_t count;
+	std::uint64_t written;
+	std::size_t position;  // Where the next key goes
+	std::size_t mappedBytes;
+};
+
+/**
+ * Creates the temporary file at its final size and maps it
+ *
+ * @param path of the tree file
+ * @param count the amount of keys that will be written
+ */
+template <class T>
+TreeFileWriter<T>::TreeFileWriter(const char* path, std::uint64_t count)
+{
+	this->path = path;
+	this->temporaryPath = this->path + ".tmp";
+	this->header = nullptr;
+	this->keys = nullptr;
+	this->count = count;
+	this->written = 0;
+	this->position = eytzingerFirst(count);
+	this->mappedBytes = treeFileDataOffset + (count + 1) * sizeof(T);
+
+	int fd = open(temporaryPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		std::cout << "Could not create tree file " << temporaryPath << "." << std::endl;
+		return;
+	}
+
+	if (ftruncate(fd, mappedBytes) == -1) {
+		std::cout << "Could not resize tree file " << temporaryPath << "." << std::endl;
+		close(fd);
+		return;
+	}
+
+	void* memory = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd); // The mapping keeps the file open
+
+	if (memory == MAP_FAILED) {
+		std::cout << "Could not map tree file " << temporaryPath << "." << std::endl;
+		return;
+	}
+
+	this->header = static_cast<TreeFileHeader*>(memory);
+	this->keys = reinterpret_cast<T*>(static_cast<char*>(memory) + treeFileDataOffset);
+}
+
+/**
+ * Throws the file away if finish() was not called
+ */
+template <class T>
+TreeFileWriter<T>::~TreeFileWriter()
+{
+	if (header != nullptr) {
+		munmap(header, mappedBytes);
+		unlink(temporaryPath.c_str());
+	}
+}
+
+template <class T>
+bool TreeFileWriter<T>::isOpen() const
+{
+	return header != nullptr;
+}
+
+/**
+ * Adds the next key. Keys must be written in ascending order.
+ */
+template <class T>
+void TreeFileWriter<T>::write(const T& key)
+{
+	if (position == 0) { // More keys than announced, or the file is not open
+		written++;
+		return;
+	}
+
+	keys[position] = key;
+	position = eytzingerNext(position, count);
+	written++;
+}
+
+/**
+ * Writes the header, flushes the file to disk, moves it into place and flushes the directory so the new name
+ * survives a crash too
+ *
+ * @return true if the file is complete and in place
+ */
+template <class T>
+bool TreeFileWriter<T>::finish()
+{
+	if (header == nullptr) {
+		return false;
+	}
+
+	bool complete = (written == count);
+	if (complete) {
+		std::memset(&keys[0], 0, sizeof(T)); // Not used, zeroed so the checksum does not depend on it
+		header->version = treeFileVersion;
+		header->keySize = sizeof(T);
+		header->count = count;
+		header->dataOffset = treeFileDataOffset;
+		header->checksum = checksumOf(reinterpret_cast<const unsigned char*>(keys), (count + 1) * sizeof(T));
+		header->magic = treeFileMagic;
+		complete = msync(header, mappedBytes, MS_SYNC) == 0
+			&& std::rename(temporaryPath.c_str(), path.c_str()) == 0
+			&& syncDirectoryOf(path);
+	} else {
+		std::cout << written << " keys were written to " << path << " instead of " << count << "." << std::endl;
+	}
+
+	munmap(header, mappedBytes);
+	header = nullptr;
+	if (!complete) {
+		unlink(temporaryPath.c_str());
+	}
+
+	return complete;
+}
+
+/**
+ * Tree file mapped read-only and searched in place. Opening it only checks the header; the keys are paged in by
+ * the searches that touch them, so a large file is usable right away.
+ */
+template <class T>
+class MappedTree {
+	static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable keys can be stored in a file");
+
+public:
+	MappedTree(const char* path);
+	~MappedTree();
+
+	MappedTree(const MappedTree&) = delete;
+	MappedTree& operator=(const MappedTree&) = delete;
+
+	bool isOpen() const;
+	bool verify() const;
+
+	const T* search(T key) const;
+	const T* lowerBound(T key) const;
+	const T* upperBound(T key) const;
+	std::size_t size() const;
+
+	template <class Visitor>
+	void forEach(Visitor visitor) const;
+
+private:
+	const TreeFileHeader* header;
+	const T* keys;
+	std::size_t mappedBytes;
+};
+
+template <class T>
+MappedTree<T>::MappedTree(const char* path)
+{
+	this->header = nullptr;
+	this->keys = nullptr;
+	this->mappedBytes = 0;
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		std::cout << "Could not open tree file " << path << "." << std::endl;
+		return;
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) == -1 || (std::uint64_t)status.st_size < treeFileDataOffset) {
+		std::cout << "Tree file " << path << " is too short." << std::endl;
+		close(fd);
+		return;
+	}
+
+	void* memory = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (memory == MAP_FAILED) {
+		std::cout << "Could not map tree file " << path << "." << std::endl;
+		return;
+	}
+
+	// Slots that fit after the header, the unused first one included. Comparing count with it before multiplying
+	// keeps a corrupt count from overflowing the size check below.
+	std::uint64_t slots = ((std::uint64_t)status.st_size - treeFileDataOffset) / sizeof(T);
+
+	const TreeFileHeader* candidate = static_cast<const TreeFileHeader*>(memory);
+	if (candidate->magic != treeFileMagic
+		|| candidate->version != treeFileVersion
+		|| candidate->keySize != sizeof(T)
+		|| candidate->dataOffset != treeFileDataOffset
+		|| candidate->count >= slots
+		|| treeFileDataOffset + (candidate->count + 1) * sizeof(T) != (std::uint64_t)status.st_size) {
+		std::cout << "Tree file " << path << " has an unknown format." << std::endl;
+		munmap(memory, status.st_size);
+		return;
+	}
+
+	this->header = candidate;
+	this->keys = reinterpret_cast<const T*>(static_cast<const char*>(memory) + candidate->dataOffset);
+	this->mappedBytes = status.st_size;
+}
+
+template <class T>
+MappedTree<T>::~MappedTree()
+{
+	if (header != nullptr) {
+		munmap(const_cast<TreeFileHeader*>(header), mappedBytes);
+	}
+}
+
+template <class T>
+bool MappedTree<T>::isOpen() const
+{
+	return header != nullptr;
+}
+
+/**
+ * Compares the checksum with the keys. Reads the whole file.
+ *
+ * @return true if the keys are intact
+ */
+template <class T>
+bool MappedTree<T>::verify() const
+{
+	return header != nullptr
+		&& checksumOf(reinterpret_cast<const unsigned char*>(keys), (header->count + 1) * sizeof(T)) == header->checksum;
+}
+
+template <class T>
+const T* MappedTree<T>::lowerBound(T key) const
+{
+	std::size_t k = eytzingerBound(keys, size(), key, true);
+	return (k == 0) ? nullptr : &keys[k];
+}
+
+template <class T>
+const T* MappedTree<T>::upperBound(T key) const
+{
+	std::size_t k = eytzingerBound(keys, size(), key, false);
+	return (k == 0) ? nullptr : &keys[k];
+}
+
+template <class T>
+const T* MappedTree<T>::search(T key) const
+{
+	const T* found = lowerBound(key);
+	return (found != nullptr && *found == key) ? found : nullptr;
+}
+
+template <class T>
+std::size_t MappedTree<T>::size() const
+{
+	return (header != nullptr) ? header->count : 0;
+}
+
+/**
+ * Reads all keys in ascending order
+ *
+ * @param visitor is called with every key
+ */
+template <class T>
+template <class Visitor>
+void MappedTree<T>::forEach(Visitor visitor) const
+{
+	std::size_t n = size();
+	for (std::size_t k = eytzingerFirst(n); k != 0; k = eytzingerNext(k, n)) {
+		visitor(keys[k]);
+	}
+}
+
+/**
+ * In-order iterator over a BinaryTree. Keeps the nodes whose left subtree is being visited on a stack, so the
+ * nodes do not need parent pointers.
+ */
+template <class T>
+class BinaryTreeIterator {
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = T;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const T*;
+	using reference = const T&;
+
+	BinaryTreeIterator(Node<T>* root)
+	{
+		pushLeft(root);
+	}
+
+	const T& operator*() const { return stack.back()->value; }
+
+	BinaryTreeIterator& operator++()
+	{
+		Node<T>* node = stack.back();
+		stack.pop_back();
+		pushLeft(node->right);
+		return *this;
+	}
+
+	bool operator==(const BinaryTreeIterator& other) const
+	{
+		return (stack.empty() || other.stack.empty()) ? stack.empty() == other.stack.empty() : stack.back() == other.stack.back();
+	}
+
+	bool operator!=(const BinaryTreeIterator& other) const { return !(*this == other); }
+
+private:
+	void pushLeft(Node<T>* node)
+	{
+		while (node != nullptr) {
+			stack.push_back(node);
+			node = node->left;
+		}
+	}
+
+	std::vector<Node<T>*> stack;
+};
+
+template <class T>
+class BinaryTree {
+public:
+	BinaryTree();
+
+	void insert(T key);
+	bool erase(T key);
+	Node<T>* search(T key);
+	void searchBatch(const T* keys, std::size_t n, Node<T>** results);
+	void clear();
+	EytzingerTree<T> freeze();
+	bool save(const char* path) const;
+	bool load(const char* path);
+
+	template <class Iterator>
+	void buildFromSorted(Iterator first, Iterator last);
+
+	template <class Iterator>
+	void buildFromSortedParallel(Iterator first, Iterator last, int threads = std::thread::hardware_concurrency());
+
+	std::size_t size() const;
+	std::size_t rank(T key) const;
+	Node<T>* select(std::size_t k) const;
+	std::size_t countInRange(T lo, T hi) const;
+
+	template <class Visitor>
+	void rangeScan(T lo, T hi, Visitor visitor) const;
+
+	template <class Visitor>
+	void levelOrder(Visitor visitor) const;
+
+	template <class Visitor>
+	void inOrder(Visitor visitor) const;
+
+	template <class Visitor>
+	void postOrder(Visitor visitor) const;
+
+	template <class Result, class Visitor, class Combine>
+	Result levelOrderParallel(Result identity, Visitor visitor, Combine combine,
+		int threads = std::thread::hardware_concurrency()) const;
+
+	BinaryTreeIterator<T> begin() const { return BinaryTreeIterator<T>(root); }
+	BinaryTreeIterator<T> end() const { return BinaryTreeIterator<T>(nullptr); }
+
+private:
+	std::size_t countBelow(T key, bool inclusive) const;
+
+	template <class Iterator>
+	static Node<T>* build(Iterator first, Node<T>* nodes, std::size_t lo, std::size_t hi, int threads);
+
+	Node<T> *root;
+	NodePool<T> pool; // Owns every node, so they are all freed together with the tree
+};
+
+template <class T>
+BinaryTree<T>::BinaryTree() 
+{
+	this->root = nullptr;
+}
+
+// Iterative, so degenerate trees can not overflow the stack
+template <class T>
+void BinaryTree<T>::insert(T key) 
+{
+	if (root == nullptr) {
+		root = pool.allocate(key);
+		return;
+	}
+
+	Node<T>* leaf = root;
+	for (;;) {
+		leaf->size++; // The new node ends up somewhere below
+		Node<T>*& child = (key < leaf->value) ? leaf->left : leaf->right;
+		if (child == nullptr) {
+			child = pool.allocate(key);
+			return;
+		}
+		leaf = child;
+	}
+}
+
+// Iterative, so degenerate trees can not overflow the stack
+template <class T>
+Node<T>* BinaryTree<T>::search(T key) 
+{
+	Node<T>* leaf = root;
+
+	while (leaf != nullptr && !(key == leaf->value)) {
+		leaf = (key < leaf->value) ? leaf->left : leaf->right;
+	}
+
+	return leaf;
+}
+
+/**
+ * Writes the keys to a tree file that MappedTree can search without loading it
+ *
+ * @return true if the file was written completely
+ */
+template <class T>
+bool BinaryTree<T>::save(const char* path) const
+{
+	TreeFileWriter<T> writer(path, size());
+	if (!writer.isOpen()) {
+		return false;
+	}
+
+	for (const T& key : *this) {
+		writer.write(key);
+	}
+
+	return writer.finish();
+}
+
+/**
+ * Replaces the keys with the ones in a tree file. The file is read in order and the tree is bulk loaded, so
+ * it ends up balanced.
+ *
+ * @return true if the file was intact and loaded
+ */
+template <class T>
+bool BinaryTree<T>::load(const char* path)
+{
+	MappedTree<T> mapped(path);
+	if (!mapped.isOpen() || !mapped.verify()) {
+		return false;
+	}
+
+	std::vector<T> sorted;
+	sorted.reserve(mapped.size());
+	mapped.forEach([&](const T& key) { sorted.push_back(key); });
+
+	buildFromSorted(sorted.begin(), sorted.end());
+	return true;
+}
+
+/**
+ * Searches many keys at once. A plain search stalls on a cache miss at every level, because the next node is
+ * only known once the current one is loaded. Here a group of lookups advances in lockstep: each pass moves every
+ * lookup in the group down one level and prefetches its next node, and that node is only dereferenced on the
+ * next pass, after the prefetches of the rest of the group have been issued. The misses of the group overlap
+ * instead of adding up. A finished lookup hands its place in the group to the next key right away.
+ *
+ * @param keys the keys to search for
+ * @param n amount of keys
+ * @param results receives the node for every key, or nullptr if the key was not found
+ */
+template <class T>
+void BinaryTree<T>::searchBatch(const T* keys, std::size_t n, Node<T>** results)
+{
+	constexpr std::size_t group = 16; // Lookups in flight, about as many misses as a core can have outstanding
+
+	std::size_t lookup[group]; // Index of the key each place in the group is searching for
+	Node<T>* cursor[group];    // Node each lookup visits next, already prefetched
+	std::size_t active = 0;
+	std::size_t next = 0;
+
+	while (active < group && next < n) {
+		lookup[active] = next++;
+		cursor[active] = root;
+		active++;
+	}
+
+	while (active > 0) {
+		std::size_t i = 0;
+		while (i < active) {
+			Node<T>* leaf = cursor[i];
+			const T& key = keys[lookup[i]];
+
+			if (leaf == nullptr || key == leaf->value) {
+				results[lookup[i]] = leaf;
+				if (next < n) {
+					lookup[i] = next++;
+					cursor[i] = root;
+					i++;
+				} else { // No keys left, the last lookup in the group moves into this place
+					active--;
+					lookup[i] = lookup[active];
+					cursor[i] = cursor[active];
+				}
+				continue;
+			}
+
+			leaf = (key < leaf->value) ? leaf->left : leaf->right;
+			__builtin_prefetch(leaf); // Prefetching nullptr does not fault
+			cursor[i] = leaf;
+			i++;
+		}
+	}
+}
+
+/**
+ * Erases a node with the given key. A node with two children takes over the value of its in-order
+ * successor (the leftmost node of its right subtree), and the successor node is unlinked instead.
+ *
+ * @param key the value to erase
+ * @return true if a node was erased, false if the key was not found
+ */
+template <class T>
+bool BinaryTree<T>::erase(T key)
+{
+	if (search(key) == nullptr) { // Checked first, so the subtree sizes are only updated when a node goes away
+		return false;
+	}
+
+	Node<T>** link = &root; // The pointer that points to leaf
+	Node<T>* leaf = root;
+
+	while (!(key == leaf->value)) {
+		leaf->size--;
+		link = (key < leaf->value) ? &leaf->left : &leaf->right;
+		leaf = *link;
+	}
+
+	leaf->size--;
+
+	if (leaf->left != nullptr && leaf->right != nullptr) {
+		Node<T>** successorLink = &leaf->right;
+		while ((*successorLink)->left != nullptr) {
+			(*successorLink)->size--;
+			successorLink = &(*successorLink)->left;
+		}
+
+		leaf->value = (*successorLink)->value;
+		link = successorLink;
+		leaf = *successorLink;
+	}
+
+	*link = (leaf->left != nullptr) ? leaf->left : leaf->right; // At most one child is left
+	pool.release(leaf);
+	return true;
+}
+
+/**
+ * Removes all nodes at once. The memory is kept by the pool for the next build.
+ */
 template <class T>
-class BinaryTree {
-public:
-	BinaryTree();
+void BinaryTree<T>::clear()
+{
+	root = nullptr;
+	pool.reset();
+}
 
-	void insert(T key);
-	Node<T>* search(T key);
+/**
+ * Exports the keys into a read-only EytzingerTree. The tree itself is left as it is.
+ *
+ * @return the search index
+ */
+template <class T>
+EytzingerTree<T> BinaryTree<T>::freeze()
+{
+	std::vector<T> sorted;
+	std::vector<Node<T>*> stack;
+	Node<T>* leaf = root;
 
-private:
-	void insert(T key, Node<T>* leaf);
-	Node<T>* search(T key, Node<T>* leaf);
+	while (leaf != nullptr || !stack.empty()) { // In-order walk without recursion
+		while (leaf != nullptr) {
+			stack.push_back(leaf);
+			leaf = leaf->left;
+		}
 
-	Node<T> *root;
-};
+		leaf = stack.back();
+		stack.pop_back();
+		sorted.push_back(leaf->value);
+		leaf = leaf->right;
+	}
+
+	return EytzingerTree<T>(sorted);
+}
 
+/**
+ * Links nodes[lo, hi) into a perfectly balanced subtree. The node at index i gets the i:th key, so every
+ * subtree owns its own slice of nodes and subtrees can be built by different threads.
+ *
+ * @param first the first sorted key
+ * @param nodes the block of nodes, one per key
+ * @param threads amount of threads that may work on this subtree
+ * @return the root of the subtree
+ */
 template <class T>
-BinaryTree<T>::BinaryTree() 
+template <class Iterator>
+Node<T>* BinaryTree<T>::build(Iterator first, Node<T>* nodes, std::size_t lo, std::size_t hi, int threads)
 {
-	this->root = nullptr;
+	if (lo == hi) {
+		return nullptr;
+	}
+
+	std::size_t mid = lo + (hi - lo) / 2;
+	Node<T>* node = &nodes[mid];
+	node->value = first[mid];
+	node->size = hi - lo;
+
+	if (threads > 1 && hi - lo > 4096) { // Build the left subtree on a thread of its own
+		std::thread left([&]() { node->left = build(first, nodes, lo, mid, threads / 2); });
+		node->right = build(first, nodes, mid + 1, hi, threads - threads / 2);
+		left.join();
+	} else {
+		node->left = build(first, nodes, lo, mid, 1);
+		node->right = build(first, nodes, mid + 1, hi, 1);
+	}
+
+	return node;
+}
+
+/**
+ * Replaces the content of the tree with a perfectly balanced tree of the given keys in O(n). All nodes are
+ * taken from the pool in one block.
+ *
+ * @param first the first key, keys must be sorted in ascending order
+ * @param last one past the last key
+ */
+template <class T>
+template <class Iterator>
+void BinaryTree<T>::buildFromSorted(Iterator first, Iterator last)
+{
+	buildFromSortedParallel(first, last, 1);
+}
+
+/**
+ * Same as buildFromSorted(), but the subtrees are built by up to threads threads at the same time
+ *
+ * @param first the first key, keys must be sorted in ascending order
+ * @param last one past the last key
+ * @param threads the largest amount of threads to use
+ */
+template <class T>
+template <class Iterator>
+void BinaryTree<T>::buildFromSortedParallel(Iterator first, Iterator last, int threads)
+{
+	clear();
+
+	std::size_t count = last - first;
+	if (count == 0) {
+		return;
+	}
+
+	root = build(first, pool.allocateBlock(count), 0, count, threads);
+}
+
+template <class T>
+std::size_t BinaryTree<T>::size() const
+{
+	return (root != nullptr) ? root->size : 0;
 }
 
-// Recursive
+/**
+ * Counts the keys below key, or below and equal to key, by adding up the left subtree sizes of the nodes where
+ * the search turns right. O(height of the tree): O(log n) after buildFromSorted(), but insert() does not balance
+ * the tree, so keys inserted in sorted order give a chain and O(n). AVLTree in AVLTree.cpp keeps the same sizes
+ * on a tree that stays balanced and answers these queries in O(log n) whatever order the keys come in.
+ */
 template <class T>
-void BinaryTree<T>::insert(T key, Node<T>* leaf) 
+std::size_t BinaryTree<T>::countBelow(T key, bool inclusive) const
 {
-	if (key < leaf->value) {
-		if (leaf->left != nullptr) {
-			insert(key, leaf->left);
+	std::size_t count = 0;
+	Node<T>* leaf = root;
+
+	while (leaf != nullptr) {
+		bool goRight = inclusive ? !(key < leaf->value) : (leaf->value < key);
+		if (goRight) {
+			count += 1 + ((leaf->left != nullptr) ? leaf->left->size : 0);
+			leaf = leaf->right;
 		} else {
-			leaf->left = new Node<T>();
-			leaf->left->value = key;
-			leaf->left->left = nullptr;
-			leaf->left->right = nullptr;
+			leaf = leaf->left;
 		}
-	} else {
-		if (leaf->right != nullptr) {
-			insert(key, leaf->right);
+	}
+
+	return count;
+}
+
+/**
+ * Amount of keys smaller than key, i.e. the position key has or would have in sorted order. O(height of the
+ * tree), see countBelow().
+ */
+template <class T>
+std::size_t BinaryTree<T>::rank(T key) const
+{
+	return countBelow(key, false);
+}
+
+/**
+ * Finds the k:th smallest key, counting from 0. O(height of the tree), see countBelow().
+ *
+ * @return the node or nullptr if the tree has k or fewer keys
+ */
+template <class T>
+Node<T>* BinaryTree<T>::select(std::size_t k) const
+{
+	Node<T>* leaf = root;
+
+	while (leaf != nullptr) {
+		std::size_t leftSize = (leaf->left != nullptr) ? leaf->left->size : 0;
+		if (k < leftSize) {
+			leaf = leaf->left;
+		} else if (k == leftSize) {
+			return leaf;
 		} else {
-			leaf->right = new Node<T>();
-			leaf->right->value = key;
-			leaf->right->right = nullptr;
-			leaf->right->left = nullptr;
+			k -= leftSize + 1;
+			leaf = leaf->right;
 		}
 	}
+
+	return nullptr;
 }
 
+/**
+ * Amount of keys from lo to hi (inclusive). O(height of the tree), see countBelow().
+ */
 template <class T>
-void BinaryTree<T>::insert(T key) 
+std::size_t BinaryTree<T>::countInRange(T lo, T hi) const
+{
+	if (hi < lo) {
+		return 0;
+	}
+
+	return countBelow(hi, true) - countBelow(lo, false);
+}
+
+/**
+ * Visits the keys from lo to hi (inclusive) in order. Subtrees that lie completely outside the range are
+ * never entered, so the cost is O(height of the tree + keys visited), see countBelow().
+ *
+ * @param visitor is called with every key in the range
+ */
+template <class T>
+template <class Visitor>
+void BinaryTree<T>::rangeScan(T lo, T hi, Visitor visitor) const
+{
+	std::vector<Node<T>*> stack;
+	Node<T>* leaf = root;
+
+	while (leaf != nullptr || !stack.empty()) {
+		while (leaf != nullptr) {
+			if (leaf->value < lo) { // The node and its left subtree are below the range
+				leaf = leaf->right;
+			} else {
+				stack.push_back(leaf);
+				leaf = leaf->left;
+			}
+		}
+
+		if (stack.empty()) {
+			return;
+		}
+
+		leaf = stack.back();
+		stack.pop_back();
+
+		if (hi < leaf->value) { // Everything from here on is above the range
+			return;
+		}
+
+		visitor(leaf->value);
+		leaf = leaf->right;
+	}
+}
+
+/**
+ * Visits all keys level by level from the root down, each level from left to right. The current level and the
+ * next one are kept in two arrays instead of a queue.
+ *
+ * @param visitor is called with every key
+ */
+template <class T>
+template <class Visitor>
+void BinaryTree<T>::levelOrder(Visitor visitor) const
 {
+	std::vector<Node<T>*> level;
+	std::vector<Node<T>*> next;
+
 	if (root != nullptr) {
-		insert(key, root);
-	} else {
-		this->root = new Node<T>(key);
+		level.push_back(root);
+	}
+
+	while (!level.empty()) {
+		for (Node<T>* node : level) {
+			visitor(node->value);
+			if (node->left != nullptr) {
+				next.push_back(node->left);
+			}
+			if (node->right != nullptr) {
+				next.push_back(node->right);
+			}
+		}
+
+		level.swap(next);
+		next.clear();
 	}
 }
 
-// Recursive
+/**
+ * Visits all keys in ascending order
+ *
+ * @param visitor is called with every key
+ */
 template <class T>
-Node<T>* BinaryTree<T>::search(T key, Node<T>* leaf) 
+template <class Visitor>
+void BinaryTree<T>::inOrder(Visitor visitor) const
 {
-	if (leaf == nullptr) {
-		return leaf;
-	} else if (key == leaf->value) {
-		return leaf;
-	} else {
-		return (key < leaf->value) ? search(key, leaf->left) : search(key, leaf->right);
+	std::vector<Node<T>*> stack;
+	Node<T>* leaf = root;
+
+	while (leaf != nullptr || !stack.empty()) {
+		while (leaf != nullptr) {
+			stack.push_back(leaf);
+			leaf = leaf->left;
+		}
+
+		leaf = stack.back();
+		stack.pop_back();
+		visitor(leaf->value);
+		leaf = leaf->right;
 	}
 }
 
+/**
+ * Visits all keys with the keys of both subtrees of a node before the node itself. A node stays on the stack
+ * until its right subtree is done, which is the case when that subtree's root was the last node visited.
+ *
+ * @param visitor is called with every key
+ */
 template <class T>
-Node<T>* BinaryTree<T>::search(T key) 
+template <class Visitor>
+void BinaryTree<T>::postOrder(Visitor visitor) const
+{
+	std::vector<Node<T>*> stack;
+	Node<T>* leaf = root;
+	Node<T>* visited = nullptr;
+
+	while (leaf != nullptr || !stack.empty()) {
+		while (leaf != nullptr) {
+			stack.push_back(leaf);
+			leaf = leaf->left;
+		}
+
+		Node<T>* top = stack.back();
+		if (top->right != nullptr && top->right != visited) {
+			leaf = top->right;
+		} else {
+			visitor(top->value);
+			visited = top;
+			stack.pop_back();
+		}
+	}
+}
+
+/**
+ * Folds all keys into one result, level by level with the nodes of every level split between threads. Each
+ * thread folds its share of the level into its own partial result and collects the children of its nodes; the
+ * children collected by all threads form the next level. Levels too small to be worth splitting are done on
+ * the calling thread. The keys are visited in no particular order.
+ *
+ * @param identity the result of an empty tree, every partial result starts from it
+ * @param visitor is called as visitor(partial, key) to fold a key into a partial result
+ * @param combine is called as combine(a, b) and returns the two partial results combined
+ * @param threads amount of threads to split the levels between
+ * @return the combined result
+ */
+template <class T>
+template <class Result, class Visitor, class Combine>
+Result BinaryTree<T>::levelOrderParallel(Result identity, Visitor visitor, Combine combine, int threads) const
+{
+	const std::size_t minimumPerThread = 4096; // Smaller shares cost more to hand out than to do
+
+	struct Partial { // Wrapped so that a bool Result does not end up bit-packed in a std::vector<bool>
+		Result value;
+	};
+
+	Result result = identity;
+	std::vector<std::vector<Node<T>*>> level; // The level, in as many pieces as threads found it
+	std::size_t width = 0;
+
+	if (root != nullptr) {
+		level.push_back(std::vector<Node<T>*>(1, root));
+		width = 1;
+	}
+
+	while (width > 0) {
+		std::size_t workers = std::max<std::size_t>(1, std::min<std::size_t>(std::max(threads, 1), width / minimumPerThread));
+		std::vector<std::vector<Node<T>*>> next(workers);
+		std::vector<Partial> partial(workers, Partial{ identity });
+
+		auto work = [&](std::size_t worker) {
+			std::size_t begin = width * worker / workers;
+			std::size_t end = width * (worker + 1) / workers;
+
+			std::size_t piece = 0; // Find where this share starts among the pieces
+			std::size_t offset = begin;
+			while (offset >= level[piece].size()) {
+				offset -= level[piece].size();
+				piece++;
+			}
+
+			Result local = identity; // Kept apart from the other threads' results until the end, no false sharing
+			std::vector<Node<T>*> children;
+
+			for (std::size_t i = begin; i < end; i++) {
+				while (offset == level[piece].size()) {
+					piece++;
+					offset = 0;
+				}
+
+				Node<T>* node = level[piece][offset++];
+				visitor(local, node->value);
+				if (node->left != nullptr) {
+					children.push_back(node->left);
+				}
+				if (node->right != nullptr) {
+					children.push_back(node->right);
+				}
+			}
+
+			partial[worker].value = local;
+			next[worker].swap(children);
+		};
+
+		std::vector<std::thread> helpers;
+		for (std::size_t worker = 1; worker < workers; worker++) {
+			helpers.emplace_back(work, worker);
+		}
+		work(0);
+		for (std::thread& helper : helpers) {
+			helper.join();
+		}
+
+		width = 0;
+		for (std::size_t worker = 0; worker < workers; worker++) {
+			result = combine(result, partial[worker].value);
+			width += next[worker].size();
+		}
+		level.swap(next);
+	}
+
+	return result;
+}
+
+/**
+ * Builds a tree from the same keys with insert() and with the bulk loaders
+ */
+void benchmarkBuild(int n)
+{
+	std::vector<int> sorted(n);
+	for (int i = 0; i < n; i++) {
+		sorted[i] = i;
+	}
+
+	std::vector<int> shuffled = sorted;
+	std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(42));
+
+	BinaryTree<int> tree;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int key : shuffled) { // Sorted input would take O(n^2)
+		tree.insert(key);
+	}
+	std::chrono::duration<double, std::milli> insertTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	tree.buildFromSorted(sorted.begin(), sorted.end());
+	std::chrono::duration<double, std::milli> buildTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	tree.buildFromSortedParallel(sorted.begin(), sorted.end());
+	std::chrono::duration<double, std::milli> parallelTime = std::chrono::steady_clock::now() - start;
+
+	std::cout << "insert() of shuffled keys: " << insertTime.count() << " ms" << std::endl;
+	std::cout << "buildFromSorted():         " << buildTime.count() << " ms" << std::endl;
+	std::cout << "buildFromSortedParallel(): " << parallelTime.count() << " ms" << std::endl;
+
+	if (tree.search(n / 3) == nullptr) {
+		std::cout << "Key missing after build!" << std::endl;
+	}
+}
+
+/**
+ * Searches random keys in a tree and in its frozen index
+ */
+void benchmarkFrozen(int n, int lookups)
+{
+	std::mt19937 random(42);
+	BinaryTree<int> tree;
+
+	for (int i = 0; i < n; i++) {
+		tree.insert(random() % (2 * n));
+	}
+
+	EytzingerTree<int> frozen = tree.freeze();
+
+	std::vector<int> keys(lookups);
+	for (int& key : keys) {
+		key = random() % (2 * n);
+	}
+
+	int found[2] = { 0, 0 };
+
+	auto start = std::chrono::steady_clock::now();
+	for (int key : keys) {
+		found[0] += (tree.search(key) != nullptr);
+	}
+	std::chrono::duration<double, std::milli> treeTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for (int key : keys) {
+		found[1] += (frozen.search(key) != nullptr);
+	}
+	std::chrono::duration<double, std::milli> frozenTime = std::chrono::steady_clock::now() - start;
+
+	std::cout << "BinaryTree:    " << treeTime.count() << " ms, " << n * sizeof(Node<int>) / 1024 << " KiB" << std::endl;
+	std::cout << "EytzingerTree: " << frozenTime.count() << " ms, " << (n + 1) * sizeof(int) / 1024 << " KiB" << std::endl;
+
+	if (found[0] != found[1]) {
+		std::cout << "Search results differ!" << std::endl;
+	}
+}
+
+/**
+ * Searches random keys one at a time and with searchBatch()
+ */
+void benchmarkBatch(int n, int lookups)
 {
-	return search(key, root);
+	std::mt19937 random(7);
+	BinaryTree<int> tree;
+
+	for (int i = 0; i < n; i++) {
+		tree.insert(random() % (2 * n));
+	}
+
+	std::vector<int> keys(lookups);
+	for (int& key : keys) {
+		key = random() % (2 * n);
+	}
+
+	std::vector<Node<int>*> single(lookups);
+	std::vector<Node<int>*> batched(lookups);
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < lookups; i++) {
+		single[i] = tree.search(keys[i]);
+	}
+	std::chrono::duration<double, std::milli> singleTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	tree.searchBatch(keys.data(), keys.size(), batched.data());
+	std::chrono::duration<double, std::milli> batchTime = std::chrono::steady_clock::now() - start;
+
+	std::cout << "search():      " << singleTime.count() << " ms" << std::endl;
+	std::cout << "searchBatch(): " << batchTime.count() << " ms" << std::endl;
+
+	if (single != batched) {
+		std::cout << "Search results differ!" << std::endl;
+	}
+}
+
+/**
+ * Sums all keys of a balanced tree with a std::queue walk (the usual hand-written BFS), with the visitors and with
+ * the parallel level-order fold
+ */
+void benchmarkTraversal(int n)
+{
+	std::vector<int> sorted(n);
+	for (int i = 0; i < n; i++) {
+		sorted[i] = i;
+	}
+
+	BinaryTree<int> tree;
+	tree.buildFromSorted(sorted.begin(), sorted.end());
+	Node<int>* root = tree.search(sorted[n / 2]); // The bulk loader puts the middle key at the root
+
+	long long sums[5] = {};
+	double times[5];
+
+	auto start = std::chrono::steady_clock::now();
+	std::queue<Node<int>*> queue;
+	queue.push(root);
+	while (!queue.empty()) {
+		Node<int>* node = queue.front();
+		queue.pop();
+		sums[0] += node->value;
+		if (node->left != nullptr) {
+			queue.push(node->left);
+		}
+		if (node->right != nullptr) {
+			queue.push(node->right);
+		}
+	}
+	times[0] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	tree.levelOrder([&](int key) { sums[1] += key; });
+	times[1] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	tree.inOrder([&](int key) { sums[2] += key; });
+	times[2] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	tree.postOrder([&](int key) { sums[3] += key; });
+	times[3] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	sums[4] = tree.levelOrderParallel(0LL,
+		[](long long& sum, int key) { sum += key; },
+		[](long long a, long long b) { return a + b; });
+	times[4] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "std::queue BFS:       " << times[0] << " ms" << std::endl;
+	std::cout << "levelOrder():         " << times[1] << " ms" << std::endl;
+	std::cout << "inOrder():            " << times[2] << " ms" << std::endl;
+	std::cout << "postOrder():          " << times[3] << " ms" << std::endl;
+	std::cout << "levelOrderParallel(): " << times[4] << " ms on " << std::thread::hardware_concurrency() << " threads" << std::endl;
+
+	for (long long sum : sums) {
+		if (sum != sums[0]) {
+			std::cout << "Sums differ!" << std::endl;
+			break;
+		}
+	}
+}
+
+/**
+ * Compares the ways to get a searchable tree back after a restart: inserting the keys one by one, loading a
+ * tree file into a BinaryTree, and searching the mapped file directly. The file is probably still in the page
+ * cache, so the mapped numbers are the best case.
+ */
+void benchmarkColdStart(int n, const char* path)
+{
+	std::mt19937 random(11);
+	std::vector<int> keys(n);
+	for (int& key : keys) {
+		key = random() % (2 * n);
+	}
+
+	BinaryTree<int> tree;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int key : keys) {
+		tree.insert(key);
+	}
+	std::chrono::duration<double, std::milli> insertTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	bool saved = tree.save(path);
+	std::chrono::duration<double, std::milli> saveTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	BinaryTree<int> loaded;
+	bool wasLoaded = loaded.load(path);
+	std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	MappedTree<int> mapped(path);
+	bool found = mapped.search(keys[n / 2]) != nullptr;
+	std::chrono::duration<double, std::milli> mapTime = std::chrono::steady_clock::now() - start;
+
+	std::cout << "insert() key by key:     " << insertTime.count() << " ms" << std::endl;
+	std::cout << "save():                  " << saveTime.count() << " ms" << std::endl;
+	std::cout << "load():                  " << loadTime.count() << " ms" << std::endl;
+	std::cout << "MappedTree first search: " << mapTime.count() << " ms" << std::endl;
+
+	if (!saved || !wasLoaded || !found || loaded.size() != tree.size()) {
+		std::cout << "Tree file round trip failed!" << std::endl;
+	}
+
+	std::remove(path);
 }
 
 int main() 
@@ -122,5 +1601,61 @@ int main()
 
 	std::cout << getNode->value << std::endl;
 
+	binaryTree.erase(5);
+	std::cout << (binaryTree.search(5) == nullptr ? "5 was erased" : "5 is still there") << std::endl;
+
+	binaryTree.clear(); // Frees nothing, the nodes are handed out again by the next inserts
+	binaryTree.insert(5);
+	std::cout << binaryTree.search(5)->value << std::endl;
+
+	for (int i = 10; i <= 100; i += 10) {
+		binaryTree.insert(i);
+	}
+
+	EytzingerTree<int> frozen = binaryTree.freeze(); // 5 10 20 30 40 50 60 70 80 90 100
+	std::cout << *frozen.lowerBound(35) << " " << *frozen.upperBound(40) << std::endl; // 40 50
+
+	std::vector<int> keys;
+	for (int key : binaryTree) {
+		std::cout << key << " "; // 5 10 20 30 40 50 60 70 80 90 100
+		keys.push_back(key);
+	}
+	std::cout << std::endl;
+
+	BinaryTree<int> balanced; // The sorted inserts above gave a chain, the queries below are O(log n) only when balanced
+	balanced.buildFromSorted(keys.begin(), keys.end());
+
+	std::cout << "Rank of 40: " << balanced.rank(40) << std::endl;                    // 4
+	std::cout << "Key with rank 4: " << balanced.select(4)->value << std::endl;       // 40
+	std::cout << "Keys from 25 to 75: " << balanced.countInRange(25, 75) << std::endl; // 5
+
+	balanced.rangeScan(25, 75, [](int key) { std::cout << key << " "; }); // 30 40 50 60 70
+	std::cout << std::endl;
+
+	binaryTree.levelOrder([](int key) { std::cout << key << " "; }); // 5 10 20 30 40 50 60 70 80 90 100 (a degenerate tree)
+	std::cout << std::endl;
+
+	int largest = binaryTree.levelOrderParallel(0,
+		[](int& partial, int key) { partial = std::max(partial, key); },
+		[](int a, int b) { return std::max(a, b); });
+	std::cout << "Largest key: " << largest << std::endl; // 100
+
+	int batchKeys[] = { 30, 35, 100 };
+	Node<int>* batchResults[3];
+	binaryTree.searchBatch(batchKeys, 3, batchResults);
+	std::cout << (batchResults[0] != nullptr) << (batchResults[1] != nullptr) << (batchResults[2] != nullptr) << std::endl; // 101
+
+	if (binaryTree.save("/tmp/binary_tree.bin")) {
+		MappedTree<int> mapped("/tmp/binary_tree.bin");
+		std::cout << *mapped.lowerBound(35) << " " << mapped.size() << std::endl; // 40 11
+		std::remove("/tmp/binary_tree.bin");
+	}
+
+	benchmarkFrozen(1000000, 2000000);
+	benchmarkBuild(1000000);
+	benchmarkBatch(1000000, 2000000);
+	benchmarkColdStart(1000000, "/tmp/binary_tree_benchmark.bin");
+	benchmarkTraversal(4000000);
+
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,490 @@
+/**
+ * @file BlockingQueue.cpp
+ *
+ * @brief Bounded circular queue with blocking enqueue/dequeue and timeouts. How a thread waits for room or for a
+ *        value is chosen at compile time with a wait strategy, so latency can be traded against CPU use:
+ *        - SpinWait:              busy-waits, lowest latency, burns a core while waiting
+ *        - SpinYieldWait:         spins for a while, then gives up the time slice
+ *        - FutexWait:             parks the thread in the kernel (Linux)
+ *        - ConditionVariableWait: parks the thread on a std::condition_variable (portable)
+ *        The parking strategies count their sleepers, so enqueue/dequeue skip the wake-up call when nobody is parked.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 10:55
+ */
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Tells the CPU that the thread is spinning
+ */
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	_mm_pause();
+#endif
+}
+
+/**
+ * Every strategy has a Signal (one for "not empty" and one for "not full") and two functions:
+ * - wait(signal, ready, deadline) waits until ready() might have become true or the deadline passed.
+ *   It may return early, the queue simply tries again. Returns false once the deadline has passed.
+ * - notify(signal) is called after a value or a free slot has been published.
+ */
+class SpinWait
+{
+public:
+	class Signal {};
+
+	template <class Ready>
+	static bool wait(Signal&, Ready ready, Clock::time_point deadline) {
+		for (int i = 0; i < 64 && !ready(); i++) {
+			cpuRelax();
+		}
+		return Clock::now() < deadline;
+	}
+
+	static void notify(Signal&) {}
+};
+
+class SpinYieldWait
+{
+public:
+	class Signal {};
+
+	template <class Ready>
+	static bool wait(Signal&, Ready ready, Clock::time_point deadline) {
+		for (int i = 0; i < 64; i++) {
+			if (ready()) {
+				return true;
+			}
+			cpuRelax();
+		}
+
+		std::this_thread::yield();
+		return Clock::now() < deadline;
+	}
+
+	static void notify(Signal&) {}
+};
+
+#ifdef __linux__
+class FutexWait
+{
+public:
+	class Signal
+	{
+	public:
+		std::atomic<std::uint32_t> epoch{0};
+		std::atomic<int> waiters{0};
+	};
+
+	template <class Ready>
+	static bool wait(Signal& signal, Ready ready, Clock::time_point deadline) {
+		std::uint32_t epoch = signal.epoch.load(std::memory_order_acquire);
+		signal.waiters.fetch_add(1, std::memory_order_seq_cst);
+
+		if (!ready()) { // Checked after registering, so a notify() from now on bumps the epoch and wakes us
+			timespec* timeout = nullptr;
+			timespec relative;
+
+			if (deadline != Clock::time_point::max()) {
+				auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - Clock::now()).count();
+				if (left < 0) {
+					left = 0;
+				}
+				relative.tv_sec = left / 1000000000;
+				relative.tv_nsec = left % 1000000000;
+				timeout = &relative;
+			}
+
+			syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&signal.epoch), FUTEX_WAIT_PRIVATE, epoch, timeout, nullptr, 0);
+		}
+
+		signal.waiters.fetch_sub(1, std::memory_order_relaxed);
+		return Clock::now() < deadline;
+	}
+
+	static void notify(Signal& signal) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (signal.waiters.load(std::memory_order_relaxed) == 0) { // Nobody is parked, skip the syscall
+			return;
+		}
+
+		signal.epoch.fetch_add(1, std::memory_order_release);
+		syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&signal.epoch), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+	}
+};
+#endif
+
+class ConditionVariableWait
+{
+public:
+	class Signal
+	{
+	public:
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::atomic<int> waiters{0};
+	};
+
+	template <class Ready>
+	static bool wait(Signal& signal, Ready ready, Clock::time_point deadline) {
+		std::unique_lock<std::mutex> lock(signal.mutex);
+		signal.waiters.fetch_add(1, std::memory_order_seq_cst);
+
+		if (!ready()) {
+			if (deadline == Clock::time_point::max()) {
+				signal.condition.wait(lock);
+			} else {
+				signal.condition.wait_until(lock, deadline);
+			}
+		}
+
+		signal.waiters.fetch_sub(1, std::memory_order_relaxed);
+		return Clock::now() < deadline;
+	}
+
+	static void notify(Signal& signal) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (signal.waiters.load(std::memory_order_relaxed) == 0) { // Nobody is parked, skip the wake-up
+			return;
+		}
+
+		{
+			// A waiter that registered but has not started waiting yet holds the mutex, so this waits for it
+			std::lock_guard<std::mutex> lock(signal.mutex);
+		}
+		signal.condition.notify_all();
+	}
+};
+
+#ifdef __linux__
+using ParkWait = FutexWait;
+#else
+using ParkWait = ConditionVariableWait;
+#endif
+
+/**
+ * Rounds a capacity up to the next power of two
+ *
+ * @param value the requested capacity
+ * @return the smallest power of two that is greater than or equal to value
+ */
+constexpr std::size_t roundUpPowerOfTwo(std::size_t value)
+{
+	std::size_t power = 1;
+	while (power < value) {
+		power <<= 1;
+	}
+
+	return power;
+}
+
+/**
+ * A slot in the ring, see MPMCQueue.cpp
+ */
+template <class T>
+class Cell
+{
+public:
+	std::atomic<std::size_t> sequence;
+	T data;
+};
+
+template <class T, std::size_t Capacity, class WaitStrategy = ParkWait>
+class BlockingQueue
+{
+public:
+	static constexpr std::size_t size = roundUpPowerOfTwo(Capacity < 2 ? 2 : Capacity);
+	static constexpr std::size_t mask = size - 1;
+
+	BlockingQueue() {
+		for (std::size_t i = 0; i < size; i++) {
+			Q[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		enqueuePos.store(0, std::memory_order_relaxed);
+		dequeuePos.store(0, std::memory_order_relaxed);
+	}
+
+	bool tryEnqueue(const T& value);
+	bool tryDequeue(T& value);
+
+	void enqueue(const T& value);
+	void dequeue(T& value);
+
+	template <class Rep, class Period>
+	bool enqueueFor(const T& value, std::chrono::duration<Rep, Period> timeout);
+
+	template <class Rep, class Period>
+	bool dequeueFor(T& value, std::chrono::duration<Rep, Period> timeout);
+
+private:
+	bool enqueueUntil(const T& value, Clock::time_point deadline);
+	bool dequeueUntil(T& value, Clock::time_point deadline);
+	bool canEnqueue() const;
+	bool canDequeue() const;
+
+	alignas(64) std::atomic<std::size_t> enqueuePos;
+	alignas(64) std::atomic<std::size_t> dequeuePos;
+	alignas(64) typename WaitStrategy::Signal notEmpty;
+	alignas(64) typename WaitStrategy::Signal notFull;
+	Cell<T> Q[size];
+};
+
+/**
+ * Enqueues value if there is room, without waiting
+ *
+ * @param value to insert into the queue
+ * @return true if the value was inserted, false if the queue is full
+ */
+template <class T, std::size_t Capacity, class WaitStrategy>
+bool BlockingQueue<T, Capacity, WaitStrategy>::tryEnqueue(const T& value)
+{
+	std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+	Cell<T>* cell;
+
+	for (;;) {
+		cell = &Q[pos & mask];
+		std::ptrdiff_t diff = (std::ptrdiff_t)cell->sequence.load(std::memory_order_acquire) - (std::ptrdiff_t)pos;
+
+		if (diff == 0) {
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->data = value;
+	cell->sequence.store(pos + 1, std::memory_order_release);
+	WaitStrategy::notify(notEmpty);
+	return true;
+}
+
+/**
+ * Dequeues a value if there is one, without waiting
+ *
+ * @param value is set to the dequeued value
+ * @return true if a value was dequeued, false if the queue is empty
+ */
+template <class T, std::size_t Capacity, class WaitStrategy>
+bool BlockingQueue<T, Capacity, WaitStrategy>::tryDequeue(T& value)
+{
+	std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+	Cell<T>* cell;
+
+	for (;;) {
+		cell = &Q[pos & mask];
+		std::ptrdiff_t diff = (std::ptrdiff_t)cell->sequence.load(std::memory_order_acquire) - (std::ptrdiff_t)(pos + 1);
+
+		if (diff == 0) {
+			if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = dequeuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	value = cell->data;
+	cell->sequence.store(pos + mask + 1, std::memory_order_release);
+	WaitStrategy::notify(notFull);
+	return true;
+}
+
+/**
+ * Checks if the slot at the rear is free, i.e. if an enqueue has a chance of succeeding
+ */
+template <class T, std::size_t Capacity, class WaitStrategy>
+bool BlockingQueue<T, Capacity, WaitStrategy>::canEnqueue() const
+{
+	std::size_t pos = enqueuePos.load(std::memory_order_seq_cst);
+	return Q[pos & mask].sequence.load(std::memory_order_seq_cst) == pos;
+}
+
+/**
+ * Checks if the slot at the front holds a value, i.e. if a dequeue has a chance of succeeding
+ */
+template <class T, std::size_t Capacity, class WaitStrategy>
+bool BlockingQueue<T, Capacity, WaitStrategy>::canDequeue() const
+{
+	std::size_t pos = dequeuePos.load(std::memory_order_seq_cst);
+	return Q[pos & mask].sequence.load(std::memory_order_seq_cst) == pos + 1;
+}
+
+template <class T, std::size_t Capacity, class WaitStrategy>
+bool BlockingQueue<T, Capacity, WaitStrategy>::enqueueUntil(const T& value, Clock::time_point deadline)
+{
+	while (!tryEnqueue(value)) {
+		if (!WaitStrategy::wait(notFull, [this]() { return canEnqueue(); }, deadline)) {
+			return tryEnqueue(value); // Last chance after the deadline
+		}
+	}
+
+	return true;
+}
+
+template <class T, std::size_t Capacity, class WaitStrategy>
+bool BlockingQueue<T, Capacity, WaitStrategy>::dequeueUntil(T& value, Clock::time_point deadline)
+{
+	while (!tryDequeue(value)) {
+		if (!WaitStrategy::wait(notEmpty, [this]() { return canDequeue(); }, deadline)) {
+			return tryDequeue(value); // Last chance after the deadline
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Enqueues value, waiting as long as it takes for room in the queue
+ *
+ * @param value to insert into the queue
+ */
+template <class T, std::size_t Capacity, class WaitStrategy>
+void BlockingQueue<T, Capacity, WaitStrategy>::enqueue(const T& value)
+{
+	enqueueUntil(value, Clock::time_point::max());
+}
+
+/**
+ * Dequeues a value, waiting as long as it takes for one to arrive
+ *
+ * @param value is set to the dequeued value
+ */
+template <class T, std::size_t Capacity, class WaitStrategy>
+void BlockingQueue<T, Capacity, WaitStrategy>::dequeue(T& value)
+{
+	dequeueUntil(value, Clock::time_point::max());
+}
+
+/**
+ * Enqueues value, waiting at most timeout for room in the queue
+ *
+ * @param value to insert into the queue
+ * @param timeout the longest time to wait
+ * @return true if the value was inserted, false if the queue stayed full
+ */
+template <class T, std::size_t Capacity, class WaitStrategy>
+template <class Rep, class Period>
+bool BlockingQueue<T, Capacity, WaitStrategy>::enqueueFor(const T& value, std::chrono::duration<Rep, Period> timeout)
+{
+	return enqueueUntil(value, Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout));
+}
+
+/**
+ * Dequeues a value, waiting at most timeout for one to arrive
+ *
+ * @param value is set to the dequeued value
+ * @param timeout the longest time to wait
+ * @return true if a value was dequeued, false if the queue stayed empty
+ */
+template <class T, std::size_t Capacity, class WaitStrategy>
+template <class Rep, class Period>
+bool BlockingQueue<T, Capacity, WaitStrategy>::dequeueFor(T& value, std::chrono::duration<Rep, Period> timeout)
+{
+	return dequeueUntil(value, Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout));
+}
+
+/**
+ * Sends timestamps with pauses in between to a consumer that blocks in dequeue(), and reports how long it took
+ * the consumer to wake up and how much CPU time the process used.
+ */
+template <class WaitStrategy>
+void benchmark(const char* name, int messages)
+{
+	static BlockingQueue<Clock::time_point, 64, WaitStrategy> queue;
+	double totalLatency = 0;
+
+	std::clock_t cpuStart = std::clock();
+	auto start = Clock::now();
+
+	std::thread consumer([&]() {
+		Clock::time_point sent;
+		for (int i = 0; i < messages; i++) {
+			queue.dequeue(sent);
+			totalLatency += std::chrono::duration<double, std::micro>(Clock::now() - sent).count();
+		}
+	});
+
+	for (int i = 0; i < messages; i++) {
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+		queue.enqueue(Clock::now());
+	}
+
+	consumer.join();
+
+	double wall = std::chrono::duration<double>(Clock::now() - start).count();
+	double cpu = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+	std::cout << name << "wake-up latency " << totalLatency / messages << " us, CPU use " << 100 * cpu / wall << " %\n";
+}
+
+int main()
+{
+	BlockingQueue<int, 4> q;
+
+	for (int i = 1; i <= 5; i++) {
+		if (!q.enqueueFor(i * 10, std::chrono::milliseconds(10))) {
+			std::cout << "Queue stayed full for 10 ms, " << i * 10 << " was not inserted\n";
+		}
+	}
+
+	int value;
+	while (q.dequeueFor(value, std::chrono::milliseconds(10))) {
+		std::cout << value << " "; // 10 20 30 40
+	}
+	std::cout << "\nQueue stayed empty for 10 ms\n";
+
+	std::thread producer([&]() {
+		for (int i = 1; i <= 8; i++) {
+			q.enqueue(i); // Blocks while the consumer is behind
+		}
+	});
+
+	for (int i = 1; i <= 8; i++) {
+		q.dequeue(value);
+		std::cout << value << " "; // 1 2 3 4 5 6 7 8
+	}
+	std::cout << "\n";
+
+	producer.join();
+
+	const int messages = 2000;
+	benchmark<SpinWait>("SpinWait:              ", messages);
+	benchmark<SpinYieldWait>("SpinYieldWait:         ", messages);
+#ifdef __linux__
+	benchmark<FutexWait>("FutexWait:             ", messages);
+#endif
+	benchmark<ConditionVariableWait>("ConditionVariableWait: ", messages);
+
+	return 0;
+}
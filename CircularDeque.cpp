@@ -0,0 +1,275 @@
+/**
+ * @file CircularDeque.cpp
+ *
+ * @brief Growable circular deque. Values are pushed and popped at both ends of one contiguous circular array,
+ *        and operator[] is a single masked index. When the array is full it is doubled and the values are copied
+ *        over in logical order with at most two memcpy calls, one for each side of the wrap.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 10:55
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+template <class T>
+class CircularDeque
+{
+public:
+	CircularDeque() : CircularDeque(8) {}
+
+	CircularDeque(std::size_t capacity) {
+		this->size = 1;
+		while (this->size < capacity) {
+			this->size <<= 1;
+		}
+		this->mask = this->size - 1;
+		this->head = 0;
+		this->length = 0;
+		this->Q = new T[this->size];
+	}
+
+	~CircularDeque() {
+		delete[] this->Q;
+	}
+
+	CircularDeque(const CircularDeque&) = delete;
+	CircularDeque& operator=(const CircularDeque&) = delete;
+
+	void pushFront(T value);
+	void pushBack(T value);
+	std::optional<T> popFront();
+	std::optional<T> popBack();
+
+	T& operator[](std::size_t index);
+	const T& operator[](std::size_t index) const;
+
+	void display() const;
+	bool isEmpty() const;
+	std::size_t count() const;
+
+private:
+	void grow();
+
+	T *Q;
+	std::size_t size;
+	std::size_t mask;
+	std::size_t head;   // Index of the front value
+	std::size_t length; // Amount of values
+};
+
+/**
+ * Doubles the array. The values from head to the end of the old array and the values that wrapped around to its
+ * start are copied to the start of the new array, so the front ends up at index 0.
+ */
+template <class T>
+void CircularDeque<T>::grow()
+{
+	T* bigger = new T[size * 2];
+	std::size_t first = size - head; // Values from head up to the end of the array, the rest wrapped around
+
+	if constexpr (std::is_trivially_copyable<T>::value) {
+		std::memcpy(bigger, Q + head, first * sizeof(T));
+		std::memcpy(bigger + first, Q, head * sizeof(T));
+	} else {
+		std::move(Q + head, Q + size, bigger);
+		std::move(Q, Q + head, bigger + first);
+	}
+
+	delete[] Q;
+	Q = bigger;
+	head = 0;
+	size *= 2;
+	mask = size - 1;
+}
+
+/**
+ * Adds value in front of the first value
+ *
+ * @param value to add
+ */
+template <class T>
+void CircularDeque<T>::pushFront(T value)
+{
+	if (length == size) {
+		grow();
+	}
+
+	head = (head - 1) & mask;
+	Q[head] = std::move(value);
+	length++;
+}
+
+/**
+ * Adds value after the last value
+ *
+ * @param value to add
+ */
+template <class T>
+void CircularDeque<T>::pushBack(T value)
+{
+	if (length == size) {
+		grow();
+	}
+
+	Q[(head + length) & mask] = std::move(value);
+	length++;
+}
+
+/**
+ * Removes the first value
+ *
+ * @return the removed value or std::nullopt if the deque is empty
+ */
+template <class T>
+std::optional<T> CircularDeque<T>::popFront()
+{
+	if (isEmpty()) {
+		return std::nullopt;
+	}
+
+	std::optional<T> value = std::move(Q[head]);
+	head = (head + 1) & mask;
+	length--;
+	return value;
+}
+
+/**
+ * Removes the last value
+ *
+ * @return the removed value or std::nullopt if the deque is empty
+ */
+template <class T>
+std::optional<T> CircularDeque<T>::popBack()
+{
+	if (isEmpty()) {
+		return std::nullopt;
+	}
+
+	length--;
+	return std::move(Q[(head + length) & mask]);
+}
+
+/**
+ * Gets the value at a position counted from the front. The index is not range checked.
+ *
+ * @param index the position, 0 is the front
+ * @return the value at the position
+ */
+template <class T>
+T& CircularDeque<T>::operator[](std::size_t index)
+{
+	return Q[(head + index) & mask];
+}
+
+template <class T>
+const T& CircularDeque<T>::operator[](std::size_t index) const
+{
+	return Q[(head + index) & mask];
+}
+
+/**
+ * Displays all values from front to back
+ */
+template <class T>
+void CircularDeque<T>::display() const
+{
+	for (std::size_t i = 0; i < length; i++) {
+		std::cout << (*this)[i] << " ";
+	}
+
+	std::cout << "\n";
+}
+
+template <class T>
+bool CircularDeque<T>::isEmpty() const
+{
+	return length == 0;
+}
+
+template <class T>
+std::size_t CircularDeque<T>::count() const
+{
+	return length;
+}
+
+/**
+ * Fills a CircularDeque and a std::deque from both ends and then sums them by index
+ */
+void benchmark(std::size_t values, int passes)
+{
+	CircularDeque<int> circular;
+	std::deque<int> standard;
+	long long circularSum = 0;
+	long long standardSum = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < values; i++) {
+		(i & 1) ? circular.pushFront((int)i) : circular.pushBack((int)i);
+	}
+	std::chrono::duration<double> circularPush = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < values; i++) {
+		(i & 1) ? standard.push_front((int)i) : standard.push_back((int)i);
+	}
+	std::chrono::duration<double> standardPush = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for (int p = 0; p < passes; p++) {
+		for (std::size_t i = 0; i < values; i++) {
+			circularSum += circular[i];
+		}
+	}
+	std::chrono::duration<double> circularScan = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for (int p = 0; p < passes; p++) {
+		for (std::size_t i = 0; i < values; i++) {
+			standardSum += standard[i];
+		}
+	}
+	std::chrono::duration<double> standardScan = std::chrono::steady_clock::now() - start;
+
+	double scanned = double(values) * passes;
+	std::cout << "CircularDeque: push " << values / circularPush.count() / 1e6 << " M/s, index scan "
+		<< scanned / circularScan.count() / 1e6 << " M/s\n";
+	std::cout << "std::deque:    push " << values / standardPush.count() / 1e6 << " M/s, index scan "
+		<< scanned / standardScan.count() / 1e6 << " M/s\n";
+
+	if (circularSum != standardSum) {
+		std::cout << "Sums differ!\n";
+	}
+}
+
+int main()
+{
+	CircularDeque<int> deque(4);
+
+	deque.pushBack(3);  // [3][ ][ ][ ]
+	deque.pushBack(4);  // [3][4][ ][ ]
+	deque.pushFront(2); // [3][4][ ][2]
+	deque.pushFront(1); // [3][4][1][2]
+	deque.pushBack(5);  // Full, grows to [1][2][3][4][5][ ][ ][ ]
+	deque.pushFront(0); // [1][2][3][4][5][ ][ ][0]
+
+	deque.display();    // 0 1 2 3 4 5
+
+	std::cout << "deque[3] = " << deque[3] << "\n"; // 3
+
+	deque.popFront();   // 1 2 3 4 5
+	deque.popBack();    // 1 2 3 4
+
+	deque.display();    // 1 2 3 4
+
+	benchmark(10000000, 10);
+
+	return 0;
+}
@@ -8,7 +8,22 @@
  * @date 2020-04-13 10:55
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <streambuf>
+
+/**
+ * Contiguous run of slots inside the circular queue
+ */
+class Span
+{
+public:
+	int* data;
+	int length;
+};
 
 class CircularQueue
 {
@@ -28,7 +43,7 @@ public:
 	}
 
 	~CircularQueue() {
-		delete this->Q;
+		delete[] this->Q;
 	}
 
 	void enqueue(int value);
@@ -36,6 +51,15 @@ public:
 	void display();
 	bool isEmpty();
 	bool isFull();
+	int count();
+
+	int reserve(int count, Span& first, Span& second);
+	void commit(int count);
+	int peek(int count, Span& first, Span& second);
+	void release(int count);
+
+	int enqueueBatch(const int* values, int count);
+	int dequeueBatch(int* values, int count);
 
 private:
 	int size;
@@ -135,6 +159,326 @@ bool CircularQueue::isEmpty() {
 	return (front == -1);
 }
 
+/**
+ * Amount of values in the circular queue
+ *
+ * @return the amount of values
+ */
+int CircularQueue::count() {
+	if (isEmpty()) {
+		return 0;
+	}
+
+	return (rear - front + size) % size + 1;
+}
+
+/**
+ * Hands out free slots after the rear so the producer can write straight into the queue. The slots are
+ * returned as one span, or as two spans when they wrap around the end of the array. Nothing is visible
+ * to the consumer until commit() is called.
+ *
+ * @param count the amount of slots wanted, negative counts are treated as 0
+ * @param first is set to the slots from the rear up to the end of the array
+ * @param second is set to the slots that wrapped around to the start of the array, or length 0
+ * @return the amount of slots reserved, which is less than count if the queue does not have room
+ */
+int CircularQueue::reserve(int count, Span& first, Span& second)
+{
+	int start = (rear + 1) % size;
+	count = std::max(0, std::min(count, size - this->count())); // A negative count would give negative span lengths
+
+	first.data = Q + start;
+	first.length = std::min(count, size - start);
+	second.data = Q;
+	second.length = count - first.length;
+
+	return count;
+}
+
+/**
+ * Makes slots handed out by reserve() part of the queue
+ *
+ * @param count the amount of slots that were written, at most what reserve() returned
+ */
+void CircularQueue::commit(int count)
+{
+	if (count <= 0) {
+		return;
+	}
+
+	if (front == -1) {
+		front = 0;
+		rear = count - 1;
+	} else {
+		rear = (rear + count) % size;
+	}
+}
+
+/**
+ * Hands out the values at the front so the consumer can read them straight from the queue. The values are
+ * returned as one span, or as two spans when they wrap around the end of the array. They stay in the queue
+ * until release() is called.
+ *
+ * @param count the amount of values wanted, negative counts are treated as 0
+ * @param first is set to the values from the front up to the end of the array
+ * @param second is set to the values that wrapped around to the start of the array, or length 0
+ * @return the amount of values available, which is less than count if the queue does not hold that many
+ */
+int CircularQueue::peek(int count, Span& first, Span& second)
+{
+	int start = (front == -1) ? 0 : front;
+	count = std::max(0, std::min(count, this->count()));
+
+	first.data = Q + start;
+	first.length = std::min(count, size - start);
+	second.data = Q;
+	second.length = count - first.length;
+
+	return count;
+}
+
+/**
+ * Removes values handed out by peek() from the queue
+ *
+ * @param count the amount of values that were consumed, at most what peek() returned
+ */
+void CircularQueue::release(int count)
+{
+	if (count <= 0) {
+		return;
+	}
+
+	if (count == this->count()) { // Everything is consumed, so lets reset the circular queue
+		front = -1;
+		rear = -1;
+	} else {
+		front = (front + count) % size;
+	}
+}
+
+/**
+ * Enqueues as many values as there is room for, with at most two memcpy calls
+ *
+ * @param values to insert into the queue
+ * @param count the amount of values
+ * @return the amount of values that were inserted
+ */
+int CircularQueue::enqueueBatch(const int* values, int count)
+{
+	Span first, second;
+	count = reserve(count, first, second);
+
+	std::memcpy(first.data, values, first.length * sizeof(int));
+	std::memcpy(second.data, values + first.length, second.length * sizeof(int));
+
+	commit(count);
+	return count;
+}
+
+/**
+ * Dequeues up to count values from the front, with at most two memcpy calls
+ *
+ * @param values is filled with the dequeued values
+ * @param count the maximum amount of values to dequeue
+ * @return the amount of values that were dequeued
+ */
+int CircularQueue::dequeueBatch(int* values, int count)
+{
+	Span first, second;
+	count = peek(count, first, second);
+
+	std::memcpy(values, first.data, first.length * sizeof(int));
+	std::memcpy(values + first.length, second.data, second.length * sizeof(int));
+
+	release(count);
+	return count;
+}
+
+/**
+ * Rounds a capacity up to the next power of two
+ *
+ * @param value the requested capacity
+ * @return the smallest power of two that is greater than or equal to value
+ */
+constexpr std::size_t roundUpPowerOfTwo(std::size_t value)
+{
+	std::size_t power = 1;
+	while (power < value) {
+		power <<= 1;
+	}
+
+	return power;
+}
+
+/**
+ * Circular queue with a power-of-two capacity. The head and tail are free-running counters that are never
+ * wrapped, so the slot is found with a bit mask instead of a modulo and the queue is full when they are
+ * exactly one capacity apart. No sentinel values are needed and nothing is printed.
+ */
+template <class T, std::size_t Capacity>
+class RingBuffer
+{
+public:
+	static constexpr std::size_t size = roundUpPowerOfTwo(Capacity);
+	static constexpr std::size_t mask = size - 1;
+
+	RingBuffer() {
+		this->head = 0;
+		this->tail = 0;
+	}
+
+	bool enqueue(const T& value);
+	bool dequeue(T& value);
+	void display();
+	bool isEmpty() const;
+	bool isFull() const;
+	std::size_t count() const;
+
+private:
+	std::size_t head; // Total amount of dequeued values
+	std::size_t tail; // Total amount of enqueued values
+	T Q[size];
+};
+
+/**
+ * Enqueues value in the ring buffer
+ *
+ * @param value to insert into the queue
+ * @return true if the value was inserted, false if the queue is full
+ */
+template <class T, std::size_t Capacity>
+bool RingBuffer<T, Capacity>::enqueue(const T& value)
+{
+	if (isFull()) {
+		return false;
+	}
+
+	Q[tail & mask] = value;
+	tail++;
+	return true;
+}
+
+/**
+ * Dequeue value from the ring buffer (front)
+ *
+ * @param value is set to the dequeued value
+ * @return true if a value was dequeued, false if the queue is empty
+ */
+template <class T, std::size_t Capacity>
+bool RingBuffer<T, Capacity>::dequeue(T& value)
+{
+	if (isEmpty()) {
+		return false;
+	}
+
+	value = Q[head & mask];
+	head++;
+	return true;
+}
+
+/**
+ * Display all values in the ring buffer in queue order
+ */
+template <class T, std::size_t Capacity>
+void RingBuffer<T, Capacity>::display()
+{
+	for (std::size_t i = head; i != tail; i++) {
+		std::cout << Q[i & mask] << " ";
+	}
+
+	std::cout << std::endl;
+}
+
+template <class T, std::size_t Capacity>
+bool RingBuffer<T, Capacity>::isEmpty() const
+{
+	return head == tail;
+}
+
+template <class T, std::size_t Capacity>
+bool RingBuffer<T, Capacity>::isFull() const
+{
+	return tail - head == size;
+}
+
+template <class T, std::size_t Capacity>
+std::size_t RingBuffer<T, Capacity>::count() const
+{
+	return tail - head;
+}
+
+/**
+ * Stream buffer that throws away everything written to it. Used to keep the logging of CircularQueue
+ * out of the terminal while it is being benchmarked.
+ */
+class NullBuffer : public std::streambuf
+{
+protected:
+	int overflow(int c) override { return c; }
+};
+
+/**
+ * Measures enqueue/dequeue throughput of CircularQueue against RingBuffer. Both queues are filled with a
+ * batch of values and drained again, over and over.
+ */
+void benchmark()
+{
+	const int batch = 512;
+	const int rounds = 20000;
+	long long checksum = 0;
+
+	NullBuffer nullBuffer;
+	std::streambuf* console = std::cout.rdbuf(&nullBuffer);
+
+	CircularQueue circularQueue(batch);
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < batch; i++) {
+			circularQueue.enqueue(i);
+		}
+		for (int i = 0; i < batch; i++) {
+			checksum += circularQueue.dequeue();
+		}
+	}
+	std::chrono::duration<double> circularTime = std::chrono::steady_clock::now() - start;
+
+	std::cout.rdbuf(console);
+
+	RingBuffer<int, batch> ringBuffer;
+	start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < batch; i++) {
+			ringBuffer.enqueue(i);
+		}
+		for (int i = 0; i < batch; i++) {
+			int value = 0;
+			ringBuffer.dequeue(value);
+			checksum += value;
+		}
+	}
+	std::chrono::duration<double> ringTime = std::chrono::steady_clock::now() - start;
+
+	int values[batch];
+	for (int i = 0; i < batch; i++) {
+		values[i] = i;
+	}
+
+	CircularQueue batchQueue(batch);
+	start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++) {
+		batchQueue.enqueueBatch(values, batch);
+		batchQueue.dequeueBatch(values, batch);
+		checksum += values[batch - 1];
+	}
+	std::chrono::duration<double> batchTime = std::chrono::steady_clock::now() - start;
+
+	double operations = 2.0 * batch * rounds;
+	std::cout << "CircularQueue:         " << operations / circularTime.count() / 1e6 << " Mops/s" << std::endl;
+	std::cout << "RingBuffer:            " << operations / ringTime.count() / 1e6 << " Mops/s" << std::endl;
+	std::cout << "CircularQueue batches: " << operations / batchTime.count() / 1e6 << " Mops/s" << std::endl;
+	std::cout << "Checksum: " << checksum << std::endl;
+}
+
 int main()
 {
 	CircularQueue q(5); // [  ][  ][  ][  ][  ]
@@ -151,6 +495,51 @@ int main()
 	q.enqueue(80); // [70][80][30][40][50]
 	
 	q.display();
+	std::cout << std::endl;
+
+	RingBuffer<int, 5> r;    // Capacity is rounded up to 8
+
+	for (int i = 1; i <= 9; i++) {
+		if (!r.enqueue(i * 10)) {
+			std::cout << "Ring buffer is full, " << i * 10 << " was not inserted" << std::endl;
+		}
+	}
+
+	int value;
+	r.dequeue(value); // 10
+	r.dequeue(value); // 20
+	r.enqueue(90);
+	r.display();      // 30 40 50 60 70 80 90
+
+	CircularQueue packets(6);
+	Span first, second;
+	int packet[] = { 1, 2, 3, 4 };
+
+	packets.enqueueBatch(packet, 4);                 // [1][2][3][4][ ][ ]
+	packets.dequeueBatch(packet, 3);                 // [ ][ ][ ][4][ ][ ]
+	int reserved = packets.reserve(4, first, second); // Two free slots at the end, two wrapped to the start
+
+	for (int i = 0; i < first.length; i++) {
+		first.data[i] = 5 + i;
+	}
+	for (int i = 0; i < second.length; i++) {
+		second.data[i] = 5 + first.length + i;
+	}
+
+	packets.commit(reserved);                        // [7][8][ ][4][5][6]
+
+	int available = packets.peek(10, first, second);
+	for (int i = 0; i < first.length; i++) {
+		std::cout << first.data[i] << " ";
+	}
+	for (int i = 0; i < second.length; i++) {
+		std::cout << second.data[i] << " ";
+	}
+	std::cout << std::endl;                          // 4 5 6 7 8
+
+	packets.release(available);
+
+	benchmark();
 
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,345 @@
+/**
+ * @file CompressedList.cpp
+ *
+ * @brief Append-only integer sequence that stores each value as the varint-encoded difference to the value before
+ *        it, packed into chunks of 256 bytes. LinkedList<int> from LinkedList.cpp spends a 16 byte node and an
+ *        allocation on every 4 byte value, while a sorted posting list with small gaps here takes little more
+ *        than a byte per value and is read front to back through memory without chasing pointers.
+ *
+ *        The differences are zigzag encoded so that unsorted values and negative steps also work, they just take
+ *        more bytes. Every chunk starts over from 0, so a chunk can be decoded without the ones before it.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 11:18
+ */
+
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <type_traits>
+
+template <class T>
+class CompressedChunk {
+public:
+	static constexpr int capacity = 240; // Makes the whole chunk 256 bytes
+
+	CompressedChunk* next;
+	int count; // Values in the chunk
+	int used;  // Bytes of the buffer in use
+	unsigned char bytes[capacity];
+};
+
+template <class T>
+class CompressedList {
+	static_assert(std::is_integral<T>::value, "CompressedList only stores integers");
+
+	using Unsigned = typename std::make_unsigned<T>::type;
+	using Signed = typename std::make_signed<T>::type;
+	using Sum = typename std::conditional<std::is_signed<T>::value, long long, unsigned long long>::type;
+
+	static constexpr int maxBytes = (sizeof(T) * CHAR_BIT + 6) / 7; // Longest varint of a T
+
+public:
+	CompressedList() {
+		this->head = nullptr;
+		this->tail = nullptr;
+		this->last = 0;
+		this->length = 0;
+		this->chunks = 0;
+	}
+
+	~CompressedList() {
+		while (head != nullptr) {
+			CompressedChunk<T>* next = head->next;
+			delete head;
+			head = next;
+		}
+	}
+
+	CompressedList(const CompressedList&) = delete;
+	CompressedList& operator=(const CompressedList&) = delete;
+
+	void append(T value);
+
+	template <class Visitor>
+	void forEach(Visitor visitor) const;
+
+	Sum sum() const;
+	std::size_t count() const;
+	std::size_t bytes() const;
+	void display() const;
+
+private:
+	static int encode(Unsigned difference, unsigned char* out);
+
+	CompressedChunk<T>* head;
+	CompressedChunk<T>* tail;
+	Unsigned last; // Last value appended, what the next difference is taken from
+	std::size_t length;
+	std::size_t chunks;
+};
+
+/**
+ * Writes difference zigzag encoded as a varint: 7 bits per byte, lowest first, with the high bit set on every
+ * byte but the last
+ *
+ * @return the number of bytes written
+ */
+template <class T>
+int CompressedList<T>::encode(Unsigned difference, unsigned char* out)
+{
+	Signed signedDifference = (Signed)difference;
+	Unsigned zigzag = (Unsigned)(difference << 1) ^ (Unsigned)(signedDifference >> (sizeof(T) * CHAR_BIT - 1));
+
+	int written = 0;
+	while (zigzag >= 0x80) {
+		out[written++] = (unsigned char)(zigzag | 0x80);
+		zigzag >>= 7;
+	}
+	out[written++] = (unsigned char)zigzag;
+
+	return written;
+}
+
+/**
+ * Appends value to the end of the list, starting a new chunk when the current one is full
+ *
+ * @param value to append
+ */
+template <class T>
+void CompressedList<T>::append(T value)
+{
+	unsigned char encoded[maxBytes];
+	int size = 0;
+
+	if (tail != nullptr) {
+		size = encode((Unsigned)((Unsigned)value - last), encoded);
+	}
+
+	if (tail == nullptr || tail->used + size > CompressedChunk<T>::capacity) {
+		CompressedChunk<T>* chunk = new CompressedChunk<T>();
+		chunk->next = nullptr;
+		chunk->count = 0;
+		chunk->used = 0;
+
+		if (tail == nullptr) {
+			head = chunk;
+		} else {
+			tail->next = chunk;
+		}
+		tail = chunk;
+		chunks++;
+
+		size = encode((Unsigned)value, encoded); // The first value of a chunk is stored as its difference to 0
+	}
+
+	std::memcpy(tail->bytes + tail->used, encoded, size);
+	tail->used += size;
+	tail->count++;
+	last = (Unsigned)value;
+	length++;
+}
+
+/**
+ * Decodes the list front to back and calls visitor with every value
+ *
+ * @param visitor is called as visitor(value)
+ */
+template <class T>
+template <class Visitor>
+void CompressedList<T>::forEach(Visitor visitor) const
+{
+	for (CompressedChunk<T>* chunk = head; chunk != nullptr; chunk = chunk->next) {
+		const unsigned char* in = chunk->bytes;
+		Unsigned value = 0;
+
+		for (int i = 0; i < chunk->count; i++) {
+			Unsigned zigzag = *in++;
+			if (zigzag >= 0x80) { // Most differences in a posting list fit in one byte
+				zigzag &= 0x7f;
+				int shift = 7;
+				unsigned char byte;
+				do {
+					byte = *in++;
+					zigzag |= (Unsigned)(byte & 0x7f) << shift;
+					shift += 7;
+				} while (byte >= 0x80);
+			}
+
+			value += (Unsigned)((zigzag >> 1) ^ (Unsigned)(0 - (zigzag & 1)));
+			visitor((T)value);
+		}
+	}
+}
+
+/**
+ * Sums all values, in a wider type so that long lists do not overflow
+ *
+ * @return the sum of all values
+ */
+template <class T>
+typename CompressedList<T>::Sum CompressedList<T>::sum() const
+{
+	Sum sum = 0;
+	forEach([&sum](T value) { sum += value; });
+
+	return sum;
+}
+
+template <class T>
+std::size_t CompressedList<T>::count() const
+{
+	return length;
+}
+
+/**
+ * @return the memory held by the list, chunks included
+ */
+template <class T>
+std::size_t CompressedList<T>::bytes() const
+{
+	return sizeof(*this) + chunks * sizeof(CompressedChunk<T>);
+}
+
+template <class T>
+void CompressedList<T>::display() const
+{
+	if (length == 0) {
+		std::cout << "List is empty!\n";
+		return;
+	}
+
+	forEach([](T value) { std::cout << value << " "; });
+	std::cout << "\n";
+}
+
+/**
+ * The list from LinkedList.cpp with a tail pointer, so that building it is not quadratic, and a sum in a wider
+ * type. Used as the baseline in the benchmark.
+ */
+template <class T>
+class Node {
+public:
+	T data;
+	Node* next;
+};
+
+template <class T>
+class LinkedList {
+public:
+	LinkedList() {
+		this->head = nullptr;
+		this->tail = nullptr;
+	}
+
+	~LinkedList() {
+		while (head != nullptr) {
+			Node<T>* next = head->next;
+			delete head;
+			head = next;
+		}
+	}
+
+	LinkedList(const LinkedList&) = delete;
+	LinkedList& operator=(const LinkedList&) = delete;
+
+	void addNode(T value) {
+		Node<T>* node = new Node<T>();
+		node->data = value;
+		node->next = nullptr;
+
+		if (head == nullptr) {
+			head = node;
+		} else {
+			tail->next = node;
+		}
+		tail = node;
+	}
+
+	long long sum() const {
+		long long sum = 0;
+		for (Node<T>* node = head; node != nullptr; node = node->next) {
+			sum += node->data;
+		}
+		return sum;
+	}
+
+private:
+	Node<T>* head;
+	Node<T>* tail;
+};
+
+/**
+ * Sums the list passes times
+ *
+ * @return millions of values decoded per second
+ */
+template <class List>
+double benchmarkSum(const List& list, int values, int passes, long long& checksum)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < passes; pass++) {
+		checksum += list.sum();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	return (double)values * passes / elapsed.count() / 1e6;
+}
+
+/**
+ * Builds both lists from the same values and compares their size and how fast they are summed
+ *
+ * @param maxGap is the largest step between two values, or 0 for unsorted random values
+ */
+void benchmark(const char* name, int values, int maxGap)
+{
+	std::mt19937 random(42);
+	LinkedList<int> linked;
+	CompressedList<int> compressed;
+
+	int value = 0;
+	for (int i = 0; i < values; i++) {
+		value = maxGap == 0 ? (int)(random() % INT_MAX) : value + 1 + (int)(random() % maxGap);
+		linked.addNode(value);
+		compressed.append(value);
+	}
+
+	const int passes = 5;
+	long long checksums[2] = { 0, 0 };
+	double linkedRate = benchmarkSum(linked, values, passes, checksums[0]);
+	double compressedRate = benchmarkSum(compressed, values, passes, checksums[1]);
+
+	std::cout << std::setw(16) << name
+		<< std::setw(12) << sizeof(Node<int>) << std::setw(14) << linkedRate
+		<< std::setw(18) << (double)compressed.bytes() / values << std::setw(14) << compressedRate
+		<< (checksums[0] == checksums[1] ? "" : "  (sums differ!)") << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	CompressedList<int> list;
+	for (int value : { 3, 7, 8, 20, 1000, 1001, -5 }) {
+		list.append(value);
+	}
+
+	list.display(); // 3 7 8 20 1000 1001 -5
+	std::cout << "Sum: " << list.sum() << ", " << list.count() << " values in " << list.bytes() << " bytes\n"; // Sum: 2034, 7 values in 296 bytes
+
+	int values = argc > 1 ? std::atoi(argv[1]) : 4000000;
+
+	std::cout << values << " values, LinkedList bytes leave out the allocator's overhead per node" << std::endl;
+	std::cout << "                      LinkedList                  CompressedList" << std::endl;
+	std::cout << "          Values  bytes/value  Mvalues/s       bytes/value  Mvalues/s" << std::endl;
+
+	benchmark("gaps 1-8", values, 8);
+	benchmark("gaps 1-1000", values, 1000);
+	benchmark("unsorted", values, 0);
+
+	return 0;
+}
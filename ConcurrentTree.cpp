@@ -0,0 +1,719 @@
+/**
+ * @file ConcurrentTree.cpp
+ *
+ * @brief Concurrent ordered set based on an external binary search tree. The keys live in the leaves and the
+ *        inner nodes only route the searches, so an insert replaces one leaf with a small subtree and an erase
+ *        replaces a leaf's parent with the leaf's sibling. Both change a single child pointer.
+ *
+ *        Searches take no locks. Updates search without locks too, then lock only the one or two nodes they
+ *        change and validate that those nodes are still linked and still point where the search saw them
+ *        (optimistic validation). If not, the update starts over. Updates on disjoint keys touch different
+ *        nodes and run in parallel.
+ *
+ *        Unlinked nodes are freed with epoch-based reclamation, as in PersistentTree.cpp: every thread announces
+ *        the epoch its operation started in, and a retired node is only freed once every thread that may still
+ *        see it is done.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 11:01
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Spins for a while after a failed attempt and then gives up the time slice
+ */
+void backoff(int& spins)
+{
+	if (++spins > 64) {
+		std::this_thread::yield();
+		spins = 0;
+	}
+}
+
+/**
+ * Lock small enough to put in every node
+ */
+class SpinLock {
+public:
+	void lock()
+	{
+		int spins = 0;
+		while (locked.exchange(true, std::memory_order_acquire)) {
+			while (locked.load(std::memory_order_relaxed)) {
+				backoff(spins);
+			}
+		}
+	}
+
+	void unlock()
+	{
+		locked.store(false, std::memory_order_release);
+	}
+
+private:
+	std::atomic<bool> locked{false};
+};
+
+template <class T>
+class Node {
+public:
+
+	Node(T value, bool infinite, Node* left, Node* right)
+	{
+		this->value = value;
+		this->infinite = infinite;
+		this->left.store(left, std::memory_order_relaxed);
+		this->right.store(right, std::memory_order_relaxed);
+	}
+
+	bool isLeaf() const { return left.load(std::memory_order_relaxed) == nullptr; }
+
+	T value;
+	bool infinite;                 // Sentinel key that is larger than every real key
+	std::atomic<Node*> left;       // Both children are nullptr in a leaf
+	std::atomic<Node*> right;
+	std::atomic<bool> removed{false}; // Set once the node is unlinked, under its lock
+	SpinLock lock;
+};
+
+/**
+ * Epoch announced by one thread. Each slot has its own cache line so threads do not slow each other down.
+ */
+class ThreadSlot {
+public:
+	static constexpr std::uint64_t idle = std::numeric_limits<std::uint64_t>::max();
+
+	alignas(64) std::atomic<std::uint64_t> epoch{idle};
+	std::atomic<bool> used{false};
+};
+
+/**
+ * Nodes unlinked by one erase, waiting until no thread can reach them anymore
+ */
+template <class T>
+class RetiredNodes {
+public:
+	std::uint64_t epoch; // Threads that announced this epoch or an older one may still see the nodes
+	Node<T>* nodes[2];
+};
+
+template <class T>
+class ConcurrentTree {
+public:
+	static constexpr int maxThreads = 128;
+
+	ConcurrentTree();
+	~ConcurrentTree();
+
+	ConcurrentTree(const ConcurrentTree&) = delete;
+	ConcurrentTree& operator=(const ConcurrentTree&) = delete;
+
+	class Handle;
+
+private:
+	static bool goesLeft(const T& key, const Node<T>* node);
+	static std::atomic<Node<T>*>& childFor(const T& key, Node<T>* node);
+
+	/**
+	 * Where a search for a key ended: the leaf it reached, its parent and its grandparent
+	 */
+	class Position {
+	public:
+		Node<T>* grandparent;
+		Node<T>* parent;
+		Node<T>* leaf;
+	};
+
+	Position find(const T& key) const;
+
+	// Two sentinel inner nodes with infinite keys, so every real leaf has a parent and a grandparent
+	Node<T>* root;
+	alignas(64) std::atomic<std::uint64_t> epoch;
+	ThreadSlot slots[maxThreads];
+
+	std::mutex orphanLock;
+	std::vector<RetiredNodes<T>> orphans; // Left behind by handles that were destroyed before freeing them
+};
+
+/**
+ * Registers a thread with the tree for as long as it lives. Every thread that uses the tree needs its own
+ * Handle; the operations go through it. At most maxThreads handles can exist at the same time: the constructor
+ * throws std::runtime_error when all slots are taken, so a Handle that exists can always be used.
+ */
+template <class T>
+class ConcurrentTree<T>::Handle {
+public:
+	Handle(ConcurrentTree& tree) : tree(tree), slot(nullptr)
+	{
+		for (ThreadSlot& candidate : tree.slots) {
+			bool expected = false;
+			if (candidate.used.compare_exchange_strong(expected, true)) {
+				slot = &candidate;
+				return;
+			}
+		}
+		throw std::runtime_error("More than " + std::to_string(maxThreads) + " handles of the same ConcurrentTree");
+	}
+
+	~Handle()
+	{
+		if (!retired.empty()) {
+			std::lock_guard<std::mutex> lock(tree.orphanLock);
+			tree.orphans.insert(tree.orphans.end(), retired.begin(), retired.end());
+		}
+		slot->used.store(false);
+	}
+
+	Handle(const Handle&) = delete;
+	Handle& operator=(const Handle&) = delete;
+
+	bool insert(T key);
+	bool erase(T key);
+	bool contains(T key);
+
+private:
+	void pin() { slot->epoch.store(tree.epoch.load()); } // Announce the epoch before reading any node
+	void unpin() { slot->epoch.store(ThreadSlot::idle); }
+	void retire(Node<T>* parent, Node<T>* leaf);
+	void reclaim();
+
+	ConcurrentTree& tree;
+	ThreadSlot* slot;
+	std::vector<RetiredNodes<T>> retired;
+};
+
+template <class T>
+ConcurrentTree<T>::ConcurrentTree()
+{
+	Node<T>* inner = new Node<T>(T(), true, new Node<T>(T(), true, nullptr, nullptr), new Node<T>(T(), true, nullptr, nullptr));
+	this->root = new Node<T>(T(), true, inner, new Node<T>(T(), true, nullptr, nullptr));
+	this->epoch.store(0);
+}
+
+/**
+ * Frees every node still in the tree and everything still waiting to be reclaimed. No handle may be alive.
+ */
+template <class T>
+ConcurrentTree<T>::~ConcurrentTree()
+{
+	for (RetiredNodes<T>& batch : orphans) {
+		delete batch.nodes[0];
+		delete batch.nodes[1];
+	}
+
+	std::vector<Node<T>*> pending;
+	pending.push_back(root);
+
+	while (!pending.empty()) { // Not recursive, the tree is unbalanced
+		Node<T>* node = pending.back();
+		pending.pop_back();
+		if (!node->isLeaf()) {
+			pending.push_back(node->left.load());
+			pending.push_back(node->right.load());
+		}
+		delete node;
+	}
+}
+
+template <class T>
+bool ConcurrentTree<T>::goesLeft(const T& key, const Node<T>* node)
+{
+	return node->infinite || key < node->value;
+}
+
+template <class T>
+std::atomic<Node<T>*>& ConcurrentTree<T>::childFor(const T& key, Node<T>* node)
+{
+	return goesLeft(key, node) ? node->left : node->right;
+}
+
+/**
+ * Walks down to the leaf where key is or would be, without taking locks
+ */
+template <class T>
+typename ConcurrentTree<T>::Position ConcurrentTree<T>::find(const T& key) const
+{
+	Position position;
+	position.grandparent = nullptr;
+	position.parent = root;
+	position.leaf = root->left.load(std::memory_order_acquire);
+
+	while (!position.leaf->isLeaf()) {
+		position.grandparent = position.parent;
+		position.parent = position.leaf;
+		position.leaf = childFor(key, position.leaf).load(std::memory_order_acquire);
+	}
+
+	return position;
+}
+
+/**
+ * @return true if key was inserted, false if it was already in the set
+ */
+template <class T>
+bool ConcurrentTree<T>::Handle::insert(T key)
+{
+	pin();
+	for (;;) {
+		Position position = tree.find(key);
+		Node<T>* leaf = position.leaf;
+		Node<T>* parent = position.parent;
+
+		if (!leaf->infinite && leaf->value == key) {
+			unpin();
+			return false;
+		}
+
+		std::lock_guard<SpinLock> lock(parent->lock);
+		std::atomic<Node<T>*>& link = childFor(key, parent);
+		if (parent->removed.load() || link.load() != leaf) { // Changed after the search, start over
+			continue;
+		}
+
+		// The new inner node routes on the larger of the two keys
+		Node<T>* added = new Node<T>(key, false, nullptr, nullptr);
+		Node<T>* inner = goesLeft(key, leaf)
+			? new Node<T>(leaf->value, leaf->infinite, added, leaf)
+			: new Node<T>(key, false, leaf, added);
+
+		link.store(inner, std::memory_order_release);
+		unpin();
+		return true;
+	}
+}
+
+/**
+ * @return true if key was found and erased
+ */
+template <class T>
+bool ConcurrentTree<T>::Handle::erase(T key)
+{
+	pin();
+	for (;;) {
+		Position position = tree.find(key);
+		Node<T>* leaf = position.leaf;
+		Node<T>* parent = position.parent;
+		Node<T>* grandparent = position.grandparent;
+
+		if (leaf->infinite || !(leaf->value == key)) {
+			unpin();
+			return false;
+		}
+
+		// Ancestors are always locked before their descendants, so two erases can not deadlock
+		std::lock_guard<SpinLock> grandparentLock(grandparent->lock);
+		std::lock_guard<SpinLock> parentLock(parent->lock);
+
+		std::atomic<Node<T>*>& link = childFor(key, grandparent);
+		if (grandparent->removed.load() || parent->removed.load() || link.load() != parent
+			|| childFor(key, parent).load() != leaf) { // Changed after the search, start over
+			continue;
+		}
+
+		Node<T>* sibling = goesLeft(key, parent) ? parent->right.load() : parent->left.load();
+		parent->removed.store(true);
+		leaf->removed.store(true);
+		link.store(sibling, std::memory_order_release);
+
+		retire(parent, leaf);
+		unpin();
+		return true;
+	}
+}
+
+template <class T>
+bool ConcurrentTree<T>::Handle::contains(T key)
+{
+	pin();
+	Node<T>* leaf = tree.find(key).leaf;
+	bool found = !leaf->infinite && leaf->value == key;
+	unpin();
+	return found;
+}
+
+/**
+ * Hands over two unlinked nodes to be freed once no thread can reach them
+ */
+template <class T>
+void ConcurrentTree<T>::Handle::retire(Node<T>* parent, Node<T>* leaf)
+{
+	RetiredNodes<T> batch;
+	batch.epoch = tree.epoch.fetch_add(1);
+	batch.nodes[0] = parent;
+	batch.nodes[1] = leaf;
+	retired.push_back(batch);
+
+	if (retired.size() >= 64) { // Scanning the slots on every erase would cost more than it frees
+		reclaim();
+	}
+}
+
+/**
+ * Frees the retired nodes that every active thread started after
+ */
+template <class T>
+void ConcurrentTree<T>::Handle::reclaim()
+{
+	std::uint64_t oldest = ThreadSlot::idle;
+	for (ThreadSlot& other : tree.slots) {
+		oldest = std::min(oldest, other.epoch.load());
+	}
+
+	std::size_t kept = 0;
+	for (RetiredNodes<T>& batch : retired) {
+		if (batch.epoch < oldest) {
+			delete batch.nodes[0];
+			delete batch.nodes[1];
+		} else {
+			retired[kept++] = batch;
+		}
+	}
+
+	retired.resize(kept);
+}
+
+/**
+ * Node of the baseline tree, the one from BinaryTreeQueue.cpp
+ */
+template <class T>
+class PlainNode {
+public:
+
+	PlainNode(T value)
+	{
+		this->value = value;
+		this->left = nullptr;
+		this->right = nullptr;
+	}
+
+	T value;
+	PlainNode* left;
+	PlainNode* right;
+};
+
+/**
+ * The tree from BinaryTreeQueue.cpp behind one reader/writer lock. Used as the baseline in the benchmark.
+ */
+template <class T>
+class LockedBinaryTree {
+public:
+	class Handle;
+
+	LockedBinaryTree() { this->root = nullptr; }
+
+	~LockedBinaryTree() {
+		std::vector<PlainNode<T>*> pending;
+		if (root != nullptr) {
+			pending.push_back(root);
+		}
+
+		while (!pending.empty()) {
+			PlainNode<T>* leaf = pending.back();
+			pending.pop_back();
+			if (leaf->left != nullptr) {
+				pending.push_back(leaf->left);
+			}
+			if (leaf->right != nullptr) {
+				pending.push_back(leaf->right);
+			}
+			delete leaf;
+		}
+	}
+
+	bool insert(T key) {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		PlainNode<T>** link = &root;
+		while (*link != nullptr) {
+			if (key == (*link)->value) {
+				return false;
+			}
+			link = (key < (*link)->value) ? &(*link)->left : &(*link)->right;
+		}
+		*link = new PlainNode<T>(key);
+		return true;
+	}
+
+	bool erase(T key) {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		PlainNode<T>** link = &root;
+		while (*link != nullptr && !(key == (*link)->value)) {
+			link = (key < (*link)->value) ? &(*link)->left : &(*link)->right;
+		}
+
+		PlainNode<T>* leaf = *link;
+		if (leaf == nullptr) {
+			return false;
+		}
+
+		if (leaf->left != nullptr && leaf->right != nullptr) { // Take over the successor's value
+			PlainNode<T>** successorLink = &leaf->right;
+			while ((*successorLink)->left != nullptr) {
+				successorLink = &(*successorLink)->left;
+			}
+			link = successorLink;
+			leaf->value = (*link)->value;
+			leaf = *link;
+		}
+
+		*link = (leaf->left != nullptr) ? leaf->left : leaf->right;
+		delete leaf;
+		return true;
+	}
+
+	bool contains(T key) {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		PlainNode<T>* leaf = root;
+		while (leaf != nullptr && !(key == leaf->value)) {
+			leaf = (key < leaf->value) ? leaf->left : leaf->right;
+		}
+		return leaf != nullptr;
+	}
+
+private:
+	std::shared_mutex mutex;
+	PlainNode<T> *root;
+};
+
+/**
+ * Same interface as ConcurrentTree<T>::Handle, so the benchmark can treat both trees alike
+ */
+template <class T>
+class LockedBinaryTree<T>::Handle {
+public:
+	Handle(LockedBinaryTree& tree) : tree(tree) {}
+
+	bool insert(T key) { return tree.insert(key); }
+	bool erase(T key) { return tree.erase(key); }
+	bool contains(T key) { return tree.contains(key); }
+
+private:
+	LockedBinaryTree& tree;
+};
+
+/**
+ * Checks the tree against what a linearizable set must do:
+ *
+ * - Every thread owns a range of keys nobody else touches. Each of its operations must return what a
+ *   sequential set would, and at the end the tree must hold exactly the keys each thread left in its range.
+ * - All threads also insert and erase a few shared keys. For every key the successful inserts and erases must
+ *   alternate, so their difference must be 0 or 1 and match whether the key is in the tree at the end.
+ * - The handles of the finished threads must have given their slots back, so maxThreads handles fit again, one
+ *   more is refused, and a slot that is given back can be taken by a new handle.
+ *
+ * @return true if no check failed
+ */
+bool stressTest(int threads, int operations)
+{
+	const int ownKeys = 256;
+	const int sharedKeys = 8;
+	const int sharedBase = threads * ownKeys;
+
+	ConcurrentTree<int> tree;
+	std::vector<std::vector<bool>> present(threads, std::vector<bool>(ownKeys, false));
+	std::vector<std::atomic<int>> balance(sharedKeys); // Successful inserts minus successful erases
+	std::atomic<int> failures(0);
+	std::vector<std::thread> workers;
+
+	for (std::atomic<int>& value : balance) {
+		value.store(0);
+	}
+
+	for (int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			ConcurrentTree<int>::Handle handle(tree);
+			std::mt19937 random(t);
+
+			for (int i = 0; i < operations; i++) {
+				unsigned choice = random();
+				if (choice % 4 == 0) {
+					int key = random() % sharedKeys;
+					if ((choice / 4) % 2 == 0) {
+						balance[key] += handle.insert(sharedBase + key);
+					} else {
+						balance[key] -= handle.erase(sharedBase + key);
+					}
+					continue;
+				}
+
+				int index = random() % ownKeys;
+				int key = t * ownKeys + index;
+				bool result;
+				bool expected;
+
+				switch ((choice / 4) % 3) {
+				case 0:
+					result = handle.insert(key);
+					expected = !present[t][index];
+					present[t][index] = true;
+					break;
+				case 1:
+					result = handle.erase(key);
+					expected = present[t][index];
+					present[t][index] = false;
+					break;
+				default:
+					result = handle.contains(key);
+					expected = present[t][index];
+				}
+
+				failures += (result != expected);
+			}
+		});
+	}
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+
+	ConcurrentTree<int>::Handle handle(tree);
+	for (int t = 0; t < threads; t++) {
+		for (int index = 0; index < ownKeys; index++) {
+			failures += (handle.contains(t * ownKeys + index) != present[t][index]);
+		}
+	}
+
+	for (int key = 0; key < sharedKeys; key++) {
+		int value = balance[key].load();
+		failures += (value != 0 && value != 1) || (handle.contains(sharedBase + key) != (value == 1));
+	}
+
+	std::vector<std::unique_ptr<ConcurrentTree<int>::Handle>> handles;
+	try {
+		while ((int)handles.size() < ConcurrentTree<int>::maxThreads - 1) { // handle holds the last slot
+			handles.emplace_back(new ConcurrentTree<int>::Handle(tree));
+		}
+	} catch (const std::runtime_error&) {
+		failures++; // A slot was not given back
+	}
+
+	try {
+		ConcurrentTree<int>::Handle extra(tree);
+		failures++;
+	} catch (const std::runtime_error&) {
+		// Expected, every slot is taken
+	}
+
+	if (!handles.empty()) {
+		handles.pop_back();
+		try {
+			ConcurrentTree<int>::Handle again(tree);
+			failures += again.contains(sharedBase + sharedKeys); // Never inserted, must be reported missing
+		} catch (const std::runtime_error&) {
+			failures++;
+		}
+	}
+
+	return failures == 0;
+}
+
+/**
+ * Lets every thread run a mix of searches, inserts and erases on random keys for a while and reports the total
+ * amount of operations per second. Half of the keys are in the tree at the start, and inserts and erases are
+ * equally likely so it stays that way.
+ *
+ * @param threads amount of threads sharing the tree
+ * @param readPercent share of the operations that are searches
+ */
+template <class Tree>
+double benchmark(int threads, int readPercent)
+{
+	const int keys = 1 << 16;
+
+	Tree tree;
+	{
+		typename Tree::Handle handle(tree);
+		std::mt19937 random(42);
+		for (int i = 0; i < keys / 2; i++) {
+			handle.insert(random() % keys);
+		}
+	}
+
+	std::atomic<bool> running(true);
+	std::atomic<long long> total(0);
+	std::atomic<long long> found(0); // Summed up so the searches can not be optimized away
+	std::vector<std::thread> workers;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			typename Tree::Handle handle(tree);
+			std::mt19937 random(t);
+			long long done = 0;
+			long long hits = 0;
+			while (running.load(std::memory_order_relaxed)) {
+				for (int i = 0; i < 256; i++) {
+					int key = random() % keys;
+					int choice = random() % 100;
+					if (choice < readPercent) {
+						hits += handle.contains(key);
+					} else if (choice % 2 == 0) {
+						handle.insert(key);
+					} else {
+						handle.erase(key);
+					}
+				}
+				done += 256;
+			}
+			total += done;
+			found += hits;
+		});
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	running = false;
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (readPercent > 0 && found == 0) {
+		std::cout << "No key was found!" << std::endl;
+	}
+
+	return total / elapsed.count() / 1e6;
+}
+
+int main()
+{
+	ConcurrentTree<int> tree;
+	ConcurrentTree<int>::Handle handle(tree);
+
+	for (int i = 10; i >= 1; i--) {
+		handle.insert(i);
+	}
+
+	std::cout << handle.insert(5) << " " << handle.erase(5) << " " << handle.contains(5) << std::endl; // 0 1 0
+
+	std::cout << "Stress test: " << (stressTest(8, 200000) ? "passed" : "FAILED") << std::endl;
+
+	for (int readPercent : { 100, 90, 50 }) {
+		std::cout << readPercent << "% searches" << std::endl;
+		std::cout << "Threads  LockedBinaryTree  ConcurrentTree  (Mops/s)" << std::endl;
+		for (int threads = 1; threads <= 64; threads *= 2) {
+			double lockedRate = benchmark<LockedBinaryTree<int>>(threads, readPercent);
+			double concurrentRate = benchmark<ConcurrentTree<int>>(threads, readPercent);
+
+			std::cout << std::setw(7) << threads << std::setw(18) << lockedRate << std::setw(16) << concurrentRate << std::endl;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,723 @@
+/**
+ * @file DaryHeap.cpp
+ *
+ * @brief Priority queues stored as d-ary heaps in one contiguous array. Every node has D children instead of
+ *        two, so the heap is log2(D) times shallower: a push climbs fewer levels, and a pop does fewer levels of
+ *        work where each level compares D children that sit next to each other in memory. With D = 4 and small
+ *        values the children of a node share a cache line, so a pop takes fewer cache misses once the heap no
+ *        longer fits in the cache.
+ *
+ *        DaryHeap is a drop-in for std::priority_queue (the largest value is on top by default) with O(n) bulk
+ *        heapify. IndexedDaryHeap keeps track of where every item is, so the priority of an item already in
+ *        the heap can be changed in O(log n), as Dijkstra's algorithm and schedulers need.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 11:01
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+template <class T, int D = 4, class Compare = std::less<T>>
+class DaryHeap {
+	static_assert(D >= 2, "A heap node needs at least two children");
+
+public:
+	DaryHeap() {}
+
+	void push(T value);
+	std::optional<T> pop();
+	const T& top() const;
+
+	template <class Iterator>
+	void heapify(Iterator first, Iterator last);
+
+	void reserve(std::size_t capacity);
+	bool isEmpty() const;
+	std::size_t size() const;
+
+private:
+	void siftUp(std::size_t i);
+	void siftDown(std::size_t i);
+
+	std::vector<T> heap; // The children of heap[i] are heap[D * i + 1] to heap[D * i + D]
+	Compare compare;     // compare(a, b) is true if b belongs above a
+};
+
+/**
+ * Moves the value at i up until its parent belongs above it. The value is held aside and the parents are moved
+ * down into the hole, which takes one move per level instead of a swap.
+ */
+template <class T, int D, class Compare>
+void DaryHeap<T, D, Compare>::siftUp(std::size_t i)
+{
+	T value = std::move(heap[i]);
+
+	while (i > 0) {
+		std::size_t parent = (i - 1) / D;
+		if (!compare(heap[parent], value)) {
+			break;
+		}
+		heap[i] = std::move(heap[parent]);
+		i = parent;
+	}
+
+	heap[i] = std::move(value);
+}
+
+/**
+ * Moves the value at i down until no child belongs above it, promoting the best child at every level
+ */
+template <class T, int D, class Compare>
+void DaryHeap<T, D, Compare>::siftDown(std::size_t i)
+{
+	std::size_t n = heap.size();
+	T value = std::move(heap[i]);
+
+	for (;;) {
+		std::size_t first = D * i + 1;
+		if (first >= n) {
+			break;
+		}
+
+		std::size_t best = first;
+		std::size_t last = std::min(first + D, n);
+		for (std::size_t child = first + 1; child < last; child++) {
+			if (compare(heap[best], heap[child])) {
+				best = child;
+			}
+		}
+
+		if (!compare(value, heap[best])) {
+			break;
+		}
+
+		heap[i] = std::move(heap[best]);
+		i = best;
+	}
+
+	heap[i] = std::move(value);
+}
+
+template <class T, int D, class Compare>
+void DaryHeap<T, D, Compare>::push(T value)
+{
+	heap.push_back(std::move(value));
+	siftUp(heap.size() - 1);
+}
+
+/**
+ * Removes the value on top
+ *
+ * @return the removed value or std::nullopt if the heap is empty
+ */
+template <class T, int D, class Compare>
+std::optional<T> DaryHeap<T, D, Compare>::pop()
+{
+	if (isEmpty()) {
+		return std::nullopt;
+	}
+
+	std::optional<T> value = std::move(heap.front());
+	T last = std::move(heap.back());
+	heap.pop_back();
+
+	if (!isEmpty()) {
+		heap.front() = std::move(last);
+		siftDown(0);
+	}
+
+	return value;
+}
+
+/**
+ * The value on top. The heap must not be empty.
+ */
+template <class T, int D, class Compare>
+const T& DaryHeap<T, D, Compare>::top() const
+{
+	return heap.front();
+}
+
+/**
+ * Replaces the contents with the given values in O(n), by sifting down every node that has children, from the
+ * last one up to the root
+ */
+template <class T, int D, class Compare>
+template <class Iterator>
+void DaryHeap<T, D, Compare>::heapify(Iterator first, Iterator last)
+{
+	heap.assign(first, last);
+
+	if (heap.size() < 2) {
+		return;
+	}
+
+	for (std::size_t i = (heap.size() - 2) / D + 1; i-- > 0;) {
+		siftDown(i);
+	}
+}
+
+template <class T, int D, class Compare>
+void DaryHeap<T, D, Compare>::reserve(std::size_t capacity)
+{
+	heap.reserve(capacity);
+}
+
+template <class T, int D, class Compare>
+bool DaryHeap<T, D, Compare>::isEmpty() const
+{
+	return heap.empty();
+}
+
+template <class T, int D, class Compare>
+std::size_t DaryHeap<T, D, Compare>::size() const
+{
+	return heap.size();
+}
+
+/**
+ * Item in an IndexedDaryHeap
+ */
+template <class Priority>
+class HeapEntry {
+public:
+	Priority priority;
+	int id;
+};
+
+/**
+ * D-ary heap of items with ids from 0 to capacity - 1, with the smallest priority on top. Every item's place in
+ * the heap is kept in an array indexed by id, so its priority can be changed without searching for it.
+ */
+template <class Priority, int D = 4>
+class IndexedDaryHeap {
+	static_assert(D >= 2, "A heap node needs at least two children");
+
+public:
+	IndexedDaryHeap(std::size_t capacity);
+
+	void push(int id, Priority priority);
+	std::optional<int> pop();
+	int top() const;
+	const Priority& topPriority() const;
+
+	bool contains(int id) const;
+	const Priority& priority(int id) const;
+	void decreaseKey(int id, Priority priority);
+	void increaseKey(int id, Priority priority);
+
+	bool isEmpty() const;
+	std::size_t size() const;
+
+private:
+	static constexpr std::size_t absent = ~std::size_t(0);
+
+	void siftUp(std::size_t i);
+	void siftDown(std::size_t i);
+	void place(std::size_t i, HeapEntry<Priority> entry);
+
+	std::vector<HeapEntry<Priority>> heap;
+	std::vector<std::size_t> position; // Index of every id in heap, or absent
+};
+
+template <class Priority, int D>
+IndexedDaryHeap<Priority, D>::IndexedDaryHeap(std::size_t capacity)
+{
+	this->position.assign(capacity, absent);
+	this->heap.reserve(capacity);
+}
+
+template <class Priority, int D>
+void IndexedDaryHeap<Priority, D>::place(std::size_t i, HeapEntry<Priority> entry)
+{
+	heap[i] = entry;
+	position[entry.id] = i;
+}
+
+template <class Priority, int D>
+void IndexedDaryHeap<Priority, D>::siftUp(std::size_t i)
+{
+	HeapEntry<Priority> entry = heap[i];
+
+	while (i > 0) {
+		std::size_t parent = (i - 1) / D;
+		if (!(entry.priority < heap[parent].priority)) {
+			break;
+		}
+		place(i, heap[parent]);
+		i = parent;
+	}
+
+	place(i, entry);
+}
+
+template <class Priority, int D>
+void IndexedDaryHeap<Priority, D>::siftDown(std::size_t i)
+{
+	std::size_t n = heap.size();
+	HeapEntry<Priority> entry = heap[i];
+
+	for (;;) {
+		std::size_t first = D * i + 1;
+		if (first >= n) {
+			break;
+		}
+
+		std::size_t best = first;
+		std::size_t last = std::min(first + D, n);
+		for (std::size_t child = first + 1; child < last; child++) {
+			if (heap[child].priority < heap[best].priority) {
+				best = child;
+			}
+		}
+
+		if (!(heap[best].priority < entry.priority)) {
+			break;
+		}
+
+		place(i, heap[best]);
+		i = best;
+	}
+
+	place(i, entry);
+}
+
+/**
+ * Adds an item. The id must not be in the heap already.
+ */
+template <class Priority, int D>
+void IndexedDaryHeap<Priority, D>::push(int id, Priority priority)
+{
+	heap.push_back(HeapEntry<Priority>{ priority, id });
+	siftUp(heap.size() - 1);
+}
+
+/**
+ * Removes the item with the smallest priority
+ *
+ * @return the id of the removed item or std::nullopt if the heap is empty
+ */
+template <class Priority, int D>
+std::optional<int> IndexedDaryHeap<Priority, D>::pop()
+{
+	if (isEmpty()) {
+		return std::nullopt;
+	}
+
+	int id = heap.front().id;
+	position[id] = absent;
+
+	HeapEntry<Priority> last = heap.back();
+	heap.pop_back();
+
+	if (!isEmpty()) {
+		place(0, last);
+		siftDown(0);
+	}
+
+	return id;
+}
+
+/**
+ * The id of the item with the smallest priority. The heap must not be empty.
+ */
+template <class Priority, int D>
+int IndexedDaryHeap<Priority, D>::top() const
+{
+	return heap.front().id;
+}
+
+template <class Priority, int D>
+const Priority& IndexedDaryHeap<Priority, D>::topPriority() const
+{
+	return heap.front().priority;
+}
+
+template <class Priority, int D>
+bool IndexedDaryHeap<Priority, D>::contains(int id) const
+{
+	return position[id] != absent;
+}
+
+/**
+ * The priority of an item in the heap
+ */
+template <class Priority, int D>
+const Priority& IndexedDaryHeap<Priority, D>::priority(int id) const
+{
+	return heap[position[id]].priority;
+}
+
+/**
+ * Lowers the priority of an item in the heap, which moves it towards the top
+ */
+template <class Priority, int D>
+void IndexedDaryHeap<Priority, D>::decreaseKey(int id, Priority priority)
+{
+	std::size_t i = position[id];
+	heap[i].priority = priority;
+	siftUp(i);
+}
+
+/**
+ * Raises the priority of an item in the heap, which moves it away from the top
+ */
+template <class Priority, int D>
+void IndexedDaryHeap<Priority, D>::increaseKey(int id, Priority priority)
+{
+	std::size_t i = position[id];
+	heap[i].priority = priority;
+	siftDown(i);
+}
+
+template <class Priority, int D>
+bool IndexedDaryHeap<Priority, D>::isEmpty() const
+{
+	return heap.empty();
+}
+
+template <class Priority, int D>
+std::size_t IndexedDaryHeap<Priority, D>::size() const
+{
+	return heap.size();
+}
+
+/**
+ * Node of a pairing heap: the first child and the next sibling
+ */
+template <class T>
+class PairingNode {
+public:
+
+	PairingNode(T value)
+	{
+		this->value = value;
+		this->child = nullptr;
+		this->sibling = nullptr;
+	}
+
+	T value;
+	PairingNode* child;
+	PairingNode* sibling;
+};
+
+/**
+ * Pairing heap with one heap-allocated node per value, the usual pointer-based alternative to an array heap.
+ * Used as a baseline in the benchmark.
+ */
+template <class T, class Compare = std::less<T>>
+class PairingHeap {
+public:
+	PairingHeap() { this->root = nullptr; this->count = 0; }
+
+	~PairingHeap() {
+		std::vector<PairingNode<T>*> pending;
+		if (root != nullptr) {
+			pending.push_back(root);
+		}
+
+		while (!pending.empty()) {
+			PairingNode<T>* node = pending.back();
+			pending.pop_back();
+			if (node->child != nullptr) {
+				pending.push_back(node->child);
+			}
+			if (node->sibling != nullptr) {
+				pending.push_back(node->sibling);
+			}
+			delete node;
+		}
+	}
+
+	PairingHeap(const PairingHeap&) = delete;
+	PairingHeap& operator=(const PairingHeap&) = delete;
+
+	void push(T value) {
+		root = meld(root, new PairingNode<T>(value));
+		count++;
+	}
+
+	std::optional<T> pop() {
+		if (root == nullptr) {
+			return std::nullopt;
+		}
+
+		PairingNode<T>* top = root;
+		std::optional<T> value = std::move(top->value);
+		root = mergePairs(top->child);
+		delete top;
+		count--;
+		return value;
+	}
+
+	const T& top() const { return root->value; }
+	bool isEmpty() const { return root == nullptr; }
+	std::size_t size() const { return count; }
+
+private:
+	PairingNode<T>* meld(PairingNode<T>* a, PairingNode<T>* b) {
+		if (a == nullptr) {
+			return b;
+		}
+		if (b == nullptr) {
+			return a;
+		}
+		if (compare(a->value, b->value)) {
+			std::swap(a, b);
+		}
+		b->sibling = a->child;
+		a->child = b;
+		return a;
+	}
+
+	// Melds the children in pairs from left to right, then the pairs from right to left (without recursion)
+	PairingNode<T>* mergePairs(PairingNode<T>* first) {
+		PairingNode<T>* pairs = nullptr; // Stack of melded pairs, linked through sibling
+
+		while (first != nullptr) {
+			PairingNode<T>* a = first;
+			PairingNode<T>* b = a->sibling;
+			first = (b != nullptr) ? b->sibling : nullptr;
+
+			a->sibling = nullptr;
+			if (b != nullptr) {
+				b->sibling = nullptr;
+			}
+
+			PairingNode<T>* pair = meld(a, b);
+			pair->sibling = pairs;
+			pairs = pair;
+		}
+
+		PairingNode<T>* result = nullptr;
+		while (pairs != nullptr) {
+			PairingNode<T>* next = pairs->sibling;
+			pairs->sibling = nullptr;
+			result = meld(result, pairs);
+			pairs = next;
+		}
+
+		return result;
+	}
+
+	PairingNode<T>* root;
+	std::size_t count;
+	Compare compare;
+};
+
+/**
+ * Pushes n random values and pops them all, repeated until about 2 million values went through
+ *
+ * @return nanoseconds per push and pop
+ */
+template <class Heap>
+double benchmarkPushPop(const std::vector<int>& values, long long& checksum)
+{
+	std::size_t rounds = std::max<std::size_t>(1, 2000000 / values.size());
+
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t round = 0; round < rounds; round++) {
+		Heap heap;
+		for (int value : values) {
+			heap.push(value);
+		}
+
+		long long previous = heap.top();
+		while (heap.size() > 0) { // The one call std::priority_queue has in common with the others
+			int value = heap.top();
+			heap.pop();
+			checksum += value;
+			if (value > previous) {
+				checksum = -1000000000000000LL; // Out of order, makes the results differ
+			}
+			previous = value;
+		}
+	}
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+	return elapsed.count() / (rounds * values.size());
+}
+
+void benchmark(std::size_t n)
+{
+	std::mt19937 random(42);
+	std::vector<int> values(n);
+	for (int& value : values) {
+		value = random();
+	}
+
+	long long checksums[5] = {};
+	double times[5];
+	times[0] = benchmarkPushPop<std::priority_queue<int>>(values, checksums[0]);
+	times[1] = benchmarkPushPop<PairingHeap<int>>(values, checksums[1]);
+	times[2] = benchmarkPushPop<DaryHeap<int, 2>>(values, checksums[2]);
+	times[3] = benchmarkPushPop<DaryHeap<int, 4>>(values, checksums[3]);
+	times[4] = benchmarkPushPop<DaryHeap<int, 8>>(values, checksums[4]);
+
+	std::cout << std::setw(10) << n;
+	for (double time : times) {
+		std::cout << std::setw(14) << time;
+	}
+
+	for (long long checksum : checksums) {
+		if (checksum != checksums[0]) {
+			std::cout << "  (results differ!)";
+			break;
+		}
+	}
+	std::cout << std::endl;
+}
+
+/**
+ * Random directed graph in compressed form: the edges of vertex v are edges[first[v]] to edges[first[v + 1] - 1]
+ */
+class Graph {
+public:
+	Graph(int vertices, int edgesPerVertex) {
+		std::mt19937 random(7);
+		first.resize(vertices + 1);
+		for (int v = 0; v < vertices; v++) {
+			first[v] = v * edgesPerVertex;
+			for (int e = 0; e < edgesPerVertex; e++) {
+				edges.push_back(std::make_pair((int)(random() % vertices), (int)(random() % 1000 + 1)));
+			}
+		}
+		first[vertices] = vertices * edgesPerVertex;
+	}
+
+	std::vector<int> first;
+	std::vector<std::pair<int, int>> edges; // Target and weight
+};
+
+/**
+ * Shortest distances from vertex 0 with an IndexedDaryHeap, lowering the priority of a vertex when a shorter
+ * path to it is found
+ */
+std::vector<long long> dijkstraIndexed(const Graph& graph)
+{
+	int vertices = graph.first.size() - 1;
+	std::vector<long long> distance(vertices, -1);
+	IndexedDaryHeap<long long> heap(vertices);
+
+	heap.push(0, 0);
+	while (!heap.isEmpty()) {
+		long long d = heap.topPriority();
+		int v = *heap.pop();
+		distance[v] = d;
+
+		for (int e = graph.first[v]; e < graph.first[v + 1]; e++) {
+			int target = graph.edges[e].first;
+			long long candidate = d + graph.edges[e].second;
+			if (distance[target] != -1) {
+				continue;
+			}
+			if (!heap.contains(target)) {
+				heap.push(target, candidate);
+			} else if (candidate < heap.priority(target)) {
+				heap.decreaseKey(target, candidate);
+			}
+		}
+	}
+
+	return distance;
+}
+
+/**
+ * Shortest distances from vertex 0 with std::priority_queue, which can not change priorities: every shorter path
+ * is pushed again and outdated entries are skipped when they come out
+ */
+std::vector<long long> dijkstraLazy(const Graph& graph)
+{
+	int vertices = graph.first.size() - 1;
+	std::vector<long long> distance(vertices, -1);
+	std::priority_queue<std::pair<long long, int>, std::vector<std::pair<long long, int>>, std::greater<std::pair<long long, int>>> heap;
+
+	heap.push(std::make_pair(0LL, 0));
+	while (!heap.empty()) {
+		std::pair<long long, int> top = heap.top();
+		heap.pop();
+		if (distance[top.second] != -1) {
+			continue;
+		}
+		distance[top.second] = top.first;
+
+		for (int e = graph.first[top.second]; e < graph.first[top.second + 1]; e++) {
+			int target = graph.edges[e].first;
+			if (distance[target] == -1) {
+				heap.push(std::make_pair(top.first + graph.edges[e].second, target));
+			}
+		}
+	}
+
+	return distance;
+}
+
+void benchmarkDijkstra(int vertices)
+{
+	Graph graph(vertices, 8);
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<long long> lazy = dijkstraLazy(graph);
+	std::chrono::duration<double, std::milli> lazyTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	std::vector<long long> indexed = dijkstraIndexed(graph);
+	std::chrono::duration<double, std::milli> indexedTime = std::chrono::steady_clock::now() - start;
+
+	std::cout << "Dijkstra on " << vertices << " vertices: std::priority_queue " << lazyTime.count()
+		<< " ms, IndexedDaryHeap " << indexedTime.count() << " ms" << (lazy == indexed ? "" : " (distances differ!)") << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	DaryHeap<int> heap;
+
+	for (int value : { 5, 1, 9, 3, 7 }) {
+		heap.push(value);
+	}
+
+	while (!heap.isEmpty()) {
+		std::cout << *heap.pop() << " "; // 9 7 5 3 1
+	}
+	std::cout << std::endl;
+
+	std::vector<int> values = { 4, 8, 15, 16, 23, 42 };
+	heap.heapify(values.begin(), values.end());
+	std::cout << heap.top() << std::endl; // 42
+
+	IndexedDaryHeap<int> tasks(4);
+	tasks.push(0, 30);
+	tasks.push(1, 10);
+	tasks.push(2, 20);
+	tasks.decreaseKey(0, 5);  // Task 0 goes first now
+	tasks.increaseKey(1, 40); // Task 1 goes last
+
+	while (!tasks.isEmpty()) {
+		std::cout << *tasks.pop() << " "; // 0 2 1
+	}
+	std::cout << std::endl;
+
+	// Pass the largest size to benchmark, e.g. 100000000 (needs around 4 GB for the pairing heap). The default
+	// keeps the run short.
+	std::size_t largest = (argc > 1) ? std::atoll(argv[1]) : 1000000;
+
+	std::cout << "    Values  priority_queue  PairingHeap  DaryHeap<2>  DaryHeap<4>  DaryHeap<8>  (ns per push + pop)" << std::endl;
+	for (std::size_t n = 1000; n <= largest; n *= 10) {
+		benchmark(n);
+	}
+
+	benchmarkDijkstra(1000000);
+
+	return 0;
+}
@@ -0,0 +1,297 @@
+/**
+ * @file MPMCQueue.cpp
+ *
+ * @brief Bounded lock-free multi-producer/multi-consumer circular queue (Dmitry Vyukov's sequence-numbered ring).
+ *        Every slot carries a sequence number that tells whether it is ready to be written or read, so an
+ *        enqueue or dequeue only needs one CAS on its own position counter.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 10:55
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+constexpr std::size_t cacheLineSize = 64;
+
+/**
+ * Rounds a capacity up to the next power of two
+ *
+ * @param value the requested capacity
+ * @return the smallest power of two that is greater than or equal to value
+ */
+constexpr std::size_t roundUpPowerOfTwo(std::size_t value)
+{
+	std::size_t power = 1;
+	while (power < value) {
+		power <<= 1;
+	}
+
+	return power;
+}
+
+/**
+ * A slot in the ring. For the lap that starts at position p the slot is free when sequence == p and
+ * holds a value when sequence == p + 1.
+ */
+template <class T>
+class Cell
+{
+public:
+	std::atomic<std::size_t> sequence;
+	T data;
+};
+
+template <class T>
+class MPMCQueue
+{
+public:
+	MPMCQueue(std::size_t capacity) {
+		this->size = roundUpPowerOfTwo(capacity < 2 ? 2 : capacity);
+		this->mask = this->size - 1;
+		this->Q = new Cell<T>[this->size]; // The only allocation the queue ever does
+
+		for (std::size_t i = 0; i < this->size; i++) {
+			this->Q[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		this->enqueuePos.store(0, std::memory_order_relaxed);
+		this->dequeuePos.store(0, std::memory_order_relaxed);
+	}
+
+	~MPMCQueue() {
+		delete[] this->Q;
+	}
+
+	MPMCQueue(const MPMCQueue&) = delete;
+	MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+	bool enqueue(const T& value);
+	bool dequeue(T& value);
+
+private:
+	Cell<T> *Q;
+	std::size_t size;
+	std::size_t mask;
+
+	alignas(cacheLineSize) std::atomic<std::size_t> enqueuePos;
+	alignas(cacheLineSize) std::atomic<std::size_t> dequeuePos;
+};
+
+/**
+ * Enqueues value in the queue. Safe to call from any number of threads.
+ *
+ * @param value to insert into the queue
+ * @return true if the value was inserted, false if the queue is full
+ */
+template <class T>
+bool MPMCQueue<T>::enqueue(const T& value)
+{
+	std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+	Cell<T>* cell;
+
+	for (;;) {
+		cell = &Q[pos & mask];
+		std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)pos;
+
+		if (diff == 0) { // The slot is free for this lap, try to claim it
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) { // The slot still holds a value from the previous lap
+			return false;
+		} else { // Another producer claimed the slot, catch up
+			pos = enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->data = value;
+	cell->sequence.store(pos + 1, std::memory_order_release); // Publish the value to the consumers
+	return true;
+}
+
+/**
+ * Dequeues value from the queue. Safe to call from any number of threads.
+ *
+ * @param value is set to the dequeued value
+ * @return true if a value was dequeued, false if the queue is empty
+ */
+template <class T>
+bool MPMCQueue<T>::dequeue(T& value)
+{
+	std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+	Cell<T>* cell;
+
+	for (;;) {
+		cell = &Q[pos & mask];
+		std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		std::ptrdiff_t diff = (std::ptrdiff_t)sequence - (std::ptrdiff_t)(pos + 1);
+
+		if (diff == 0) { // The slot holds a value for this lap, try to claim it
+			if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) { // The slot has not been written yet
+			return false;
+		} else { // Another consumer claimed the slot, catch up
+			pos = dequeuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	value = cell->data;
+	cell->sequence.store(pos + mask + 1, std::memory_order_release); // Free the slot for the next lap
+	return true;
+}
+
+/**
+ * The circular queue from CircularQueue.cpp without the logging, guarded by a single mutex.
+ * Used as the baseline in the benchmark.
+ */
+class LockedCircularQueue
+{
+public:
+	LockedCircularQueue(int value) {
+		this->front = -1;
+		this->rear = -1;
+		this->size = value;
+		this->Q = new int[value];
+	}
+
+	~LockedCircularQueue() {
+		delete[] this->Q;
+	}
+
+	bool enqueue(int value) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if ((front == rear + 1) || (front == 0 && rear == size - 1)) {
+			return false;
+		}
+
+		if (front == -1) {
+			front = 0;
+		}
+
+		rear = (rear + 1) % size;
+		Q[rear] = value;
+		return true;
+	}
+
+	bool dequeue(int& value) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (front == -1) {
+			return false;
+		}
+
+		value = Q[front];
+		if (front == rear) {
+			front = -1;
+			rear = -1;
+		} else {
+			front = (front + 1) % size;
+		}
+
+		return true;
+	}
+
+private:
+	std::mutex mutex;
+	int size;
+	int front;
+	int rear;
+	int *Q;
+};
+
+/**
+ * Spins for a while after a failed operation and then gives up the time slice
+ */
+void backoff(int& spins)
+{
+	if (++spins > 64) {
+		std::this_thread::yield();
+		spins = 0;
+	}
+}
+
+/**
+ * Lets every thread enqueue a value and dequeue a value, over and over, and reports the total amount of
+ * operations per second.
+ *
+ * @param queue the queue to run the benchmark on
+ * @param threads amount of threads sharing the queue
+ * @param operations total amount of enqueue/dequeue pairs, split between the threads
+ */
+template <class Queue>
+double benchmark(Queue& queue, int threads, int operations)
+{
+	std::vector<std::thread> workers;
+	std::atomic<long long> checksum(0);
+	int perThread = operations / threads;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			long long sum = 0;
+			int value;
+			for (int i = 0; i < perThread; i++) {
+				int spins = 0;
+				while (!queue.enqueue(t)) { backoff(spins); }
+				while (!queue.dequeue(value)) { backoff(spins); }
+				sum += value;
+			}
+			checksum += sum;
+		});
+	}
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (checksum != (long long)perThread * threads * (threads - 1) / 2) {
+		std::cout << "Checksum mismatch!" << std::endl;
+	}
+
+	return 2.0 * perThread * threads / elapsed.count() / 1e6;
+}
+
+int main()
+{
+	MPMCQueue<int> q(5); // Capacity is rounded up to 8
+
+	for (int i = 1; i <= 9; i++) {
+		if (!q.enqueue(i * 10)) {
+			std::cout << "Queue is full, " << i * 10 << " was not inserted" << std::endl;
+		}
+	}
+
+	int value;
+	while (q.dequeue(value)) {
+		std::cout << value << " "; // 10 20 30 40 50 60 70 80
+	}
+	std::cout << std::endl;
+
+	const int operations = 2000000;
+
+	std::cout << "Threads  LockedCircularQueue  MPMCQueue  (Mops/s)" << std::endl;
+	for (int threads = 1; threads <= 64; threads *= 2) {
+		LockedCircularQueue locked(1024);
+		MPMCQueue<int> lockFree(1024);
+
+		double lockedRate = benchmark(locked, threads, operations);
+		double lockFreeRate = benchmark(lockFree, threads, operations);
+
+		std::cout << std::setw(7) << threads << std::setw(21) << lockedRate << std::setw(11) << lockFreeRate << std::endl;
+	}
+
+	return 0;
+}
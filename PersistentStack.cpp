@@ -0,0 +1,518 @@
+/**
+ * @file PersistentStack.cpp
+ *
+ * @brief Immutable, reference-counted stack and list where every version shares its tail with the versions it was
+ *        made from. Push, pop and cons allocate at most one node and never touch the rest of the chain, so a
+ *        snapshot for undo or replay is a pointer copy instead of the O(n) copy that Stack<T> from
+ *        StackLinkedList.cpp or LinkedList<T> from LinkedList.cpp need. Edits in the middle of a list copy the
+ *        nodes in front of the edit and share the rest.
+ *
+ *        A node is freed when the last version that reaches it goes away. The reference counts are plain ints,
+ *        so versions may be read from several threads but must be copied and destroyed on one.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 11:12
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+template <class T>
+class PersistentNode {
+public:
+	PersistentNode(const T& data, PersistentNode* next) : data(data), next(next), refs(1) {}
+
+	const T data;
+	PersistentNode* const next; // The reference to next is owned by this node
+	int refs;
+};
+
+template <class T>
+PersistentNode<T>* retain(PersistentNode<T>* node)
+{
+	if (node != nullptr) {
+		node->refs++;
+	}
+	return node;
+}
+
+/**
+ * Drops a reference to node and frees every node that is no longer reachable. Loops instead of recursing so
+ * that dropping a long chain does not overflow the call stack.
+ */
+template <class T>
+void release(PersistentNode<T>* node)
+{
+	while (node != nullptr && --node->refs == 0) {
+		PersistentNode<T>* next = node->next;
+		delete node;
+		node = next;
+	}
+}
+
+template <class T>
+class PersistentStack {
+public:
+	PersistentStack() {
+		this->top = nullptr;
+		this->length = 0;
+	}
+
+	PersistentStack(const PersistentStack& other) {
+		this->top = retain(other.top);
+		this->length = other.length;
+	}
+
+	PersistentStack(PersistentStack&& other) noexcept {
+		this->top = std::exchange(other.top, nullptr);
+		this->length = std::exchange(other.length, 0);
+	}
+
+	PersistentStack& operator=(PersistentStack other) noexcept {
+		std::swap(top, other.top);
+		std::swap(length, other.length);
+		return *this;
+	}
+
+	~PersistentStack() {
+		release(top);
+	}
+
+	void push(const T& value);
+	std::optional<T> pop();
+	std::optional<T> peek() const;
+	bool isEmpty() const;
+	int count() const;
+	void display() const;
+
+private:
+	PersistentNode<T>* top;
+	int length;
+};
+
+/**
+ * Pushes value to this version of the stack. Copies of the stack taken before still see the old top.
+ *
+ * @param value to push to the top of the stack
+ */
+template <class T>
+void PersistentStack<T>::push(const T& value)
+{
+	top = new PersistentNode<T>(value, top); // The new node takes over our reference to the old top
+	length++;
+}
+
+/**
+ * Pops value from the top of this version of the stack. The node is only freed if no other version shares it.
+ *
+ * @return the popped value or std::nullopt if the stack is empty
+ */
+template <class T>
+std::optional<T> PersistentStack<T>::pop()
+{
+	if (isEmpty()) {
+		return std::nullopt;
+	}
+
+	PersistentNode<T>* node = top;
+	std::optional<T> value = node->data;
+	top = retain(node->next);
+	length--;
+	release(node);
+
+	return value;
+}
+
+template <class T>
+std::optional<T> PersistentStack<T>::peek() const
+{
+	if (isEmpty()) {
+		return std::nullopt;
+	}
+
+	return top->data;
+}
+
+template <class T>
+bool PersistentStack<T>::isEmpty() const
+{
+	return top == nullptr;
+}
+
+template <class T>
+int PersistentStack<T>::count() const
+{
+	return length;
+}
+
+template <class T>
+void PersistentStack<T>::display() const
+{
+	for (PersistentNode<T>* node = top; node != nullptr; node = node->next) {
+		std::cout << node->data << " ";
+	}
+
+	std::cout << "\n";
+}
+
+template <class T>
+class PersistentList {
+public:
+	PersistentList() {
+		this->head = nullptr;
+		this->length = 0;
+	}
+
+	PersistentList(const PersistentList& other) {
+		this->head = retain(other.head);
+		this->length = other.length;
+	}
+
+	PersistentList(PersistentList&& other) noexcept {
+		this->head = std::exchange(other.head, nullptr);
+		this->length = std::exchange(other.length, 0);
+	}
+
+	PersistentList& operator=(PersistentList other) noexcept {
+		std::swap(head, other.head);
+		std::swap(length, other.length);
+		return *this;
+	}
+
+	~PersistentList() {
+		release(head);
+	}
+
+	PersistentList cons(const T& value) const;
+	PersistentList tail() const;
+	PersistentList insertAtIndex(int index, const T& value) const;
+	PersistentList deleteAtIndex(int index) const;
+	PersistentList reverse() const;
+
+	std::optional<T> front() const;
+	bool isEmpty() const;
+	int count() const;
+	T sum() const;
+	void display() const;
+
+private:
+	PersistentList(PersistentNode<T>* head, int length) {
+		this->head = head;
+		this->length = length;
+	}
+
+	PersistentList rebuild(int index, PersistentNode<T>* rest, int length) const;
+
+	PersistentNode<T>* head;
+	int length;
+};
+
+/**
+ * @return a list with value in front of this list, sharing all of this list's nodes
+ */
+template <class T>
+PersistentList<T> PersistentList<T>::cons(const T& value) const
+{
+	return PersistentList(new PersistentNode<T>(value, retain(head)), length + 1);
+}
+
+/**
+ * @return the list without its first value, or an empty list if this one is empty
+ */
+template <class T>
+PersistentList<T> PersistentList<T>::tail() const
+{
+	if (isEmpty()) {
+		return PersistentList();
+	}
+
+	return PersistentList(retain(head->next), length - 1);
+}
+
+/**
+ * Copies the first index nodes of this list in front of rest, which the new list takes over a reference to
+ */
+template <class T>
+PersistentList<T> PersistentList<T>::rebuild(int index, PersistentNode<T>* rest, int length) const
+{
+	std::vector<const T*> prefix;
+	prefix.reserve(index);
+	for (PersistentNode<T>* node = head; (int)prefix.size() < index; node = node->next) {
+		prefix.push_back(&node->data);
+	}
+
+	for (auto it = prefix.rbegin(); it != prefix.rend(); ++it) {
+		rest = new PersistentNode<T>(**it, rest);
+	}
+
+	return PersistentList(rest, length);
+}
+
+/**
+ * Inserts value at index, copying the nodes in front of it and sharing the ones after it
+ *
+ * @param index is the position of the new value, 0 to count()
+ * @return the new list, or a copy of this list if index is out of range
+ */
+template <class T>
+PersistentList<T> PersistentList<T>::insertAtIndex(int index, const T& value) const
+{
+	if (index < 0 || index > length) {
+		std::cout << "Index out of range!\n";
+		return *this;
+	}
+
+	PersistentNode<T>* node = head;
+	for (int i = 0; i < index; i++) {
+		node = node->next;
+	}
+
+	return rebuild(index, new PersistentNode<T>(value, retain(node)), length + 1);
+}
+
+/**
+ * Removes the value at index, copying the nodes in front of it and sharing the ones after it
+ *
+ * @param index is the position of the value to remove, 0 to count() - 1
+ * @return the new list, or a copy of this list if index is out of range
+ */
+template <class T>
+PersistentList<T> PersistentList<T>::deleteAtIndex(int index) const
+{
+	if (index < 0 || index >= length) {
+		std::cout << "Index out of range!\n";
+		return *this;
+	}
+
+	PersistentNode<T>* node = head;
+	for (int i = 0; i < index; i++) {
+		node = node->next;
+	}
+
+	return rebuild(index, retain(node->next), length - 1);
+}
+
+/**
+ * @return a reversed copy of the list. Nothing can be shared as every next pointer changes.
+ */
+template <class T>
+PersistentList<T> PersistentList<T>::reverse() const
+{
+	PersistentNode<T>* reversed = nullptr;
+	for (PersistentNode<T>* node = head; node != nullptr; node = node->next) {
+		reversed = new PersistentNode<T>(node->data, reversed);
+	}
+
+	return PersistentList(reversed, length);
+}
+
+template <class T>
+std::optional<T> PersistentList<T>::front() const
+{
+	if (isEmpty()) {
+		return std::nullopt;
+	}
+
+	return head->data;
+}
+
+template <class T>
+bool PersistentList<T>::isEmpty() const
+{
+	return head == nullptr;
+}
+
+template <class T>
+int PersistentList<T>::count() const
+{
+	return length;
+}
+
+template <class T>
+T PersistentList<T>::sum() const
+{
+	T sum = T();
+	for (PersistentNode<T>* node = head; node != nullptr; node = node->next) {
+		sum += node->data;
+	}
+
+	return sum;
+}
+
+template <class T>
+void PersistentList<T>::display() const
+{
+	if (isEmpty()) {
+		std::cout << "List is empty!\n";
+		return;
+	}
+
+	for (PersistentNode<T>* node = head; node != nullptr; node = node->next) {
+		std::cout << node->data << " ";
+	}
+
+	std::cout << "\n";
+}
+
+/**
+ * The stack from StackLinkedList.cpp without the logging, with a copy constructor that copies every node the way
+ * snapshots were taken before. Used as the baseline in the benchmark.
+ */
+template <class T>
+class Node {
+public:
+	Node* next;
+	T data;
+};
+
+template <class T>
+class Stack {
+public:
+	Stack() {
+		this->top = nullptr;
+	}
+
+	Stack(const Stack& other) {
+		this->top = nullptr;
+		Node<T>** last = &this->top;
+		for (Node<T>* node = other.top; node != nullptr; node = node->next) {
+			*last = new Node<T>{ nullptr, node->data };
+			last = &(*last)->next;
+		}
+	}
+
+	Stack& operator=(const Stack&) = delete;
+
+	~Stack() {
+		while (!isEmpty()) {
+			pop();
+		}
+	}
+
+	void push(T value) {
+		top = new Node<T>{ top, value };
+	}
+
+	std::optional<T> pop() {
+		std::optional<T> value = std::nullopt;
+		if (!isEmpty()) {
+			value = top->data;
+			Node<T>* node = top;
+			top = top->next;
+			delete node;
+		}
+		return value;
+	}
+
+	bool isEmpty() const { return top == nullptr; }
+
+private:
+	Node<T>* top;
+};
+
+/**
+ * Int that counts how many copies of it are alive. Every node of both stacks holds exactly one value, so after a
+ * run the count is the amount of nodes alive, without the node types having to count themselves.
+ */
+class CountedInt {
+public:
+	CountedInt(int value = 0) : value(value) { live++; }
+	CountedInt(const CountedInt& other) : value(other.value) { live++; }
+	CountedInt& operator=(const CountedInt& other) { value = other.value; return *this; }
+	~CountedInt() { live--; }
+
+	operator int() const { return value; }
+
+	int value;
+	static inline std::size_t live = 0;
+};
+
+/**
+ * Fills a stack with depth values, then does random pushes and pops and keeps a snapshot of the last history
+ * versions for undo, the way an editor would. The depth stays within 16 of where it started. Both stacks hold
+ * CountedInt values, so they pay the same for the counting.
+ *
+ * @return nanoseconds per operation including its snapshot, and bytes held per snapshot
+ */
+template <class Snapshot, class NodeType>
+std::pair<double, double> benchmarkSnapshots(int depth, int operations, int history, long long& checksum)
+{
+	std::mt19937 random(42);
+	Snapshot stack;
+	for (int i = 0; i < depth; i++) {
+		stack.push(i);
+	}
+
+	std::size_t before = CountedInt::live;
+	std::vector<std::optional<Snapshot>> undo(history);
+
+	auto start = std::chrono::steady_clock::now();
+	int current = depth;
+	for (int i = 0; i < operations; i++) {
+		if (current == 0 || (current < depth + 16 && random() % 2 == 0)) {
+			stack.push(i);
+			current++;
+		} else {
+			checksum += stack.pop().value_or(0);
+			current--;
+		}
+		undo[i % history].emplace(stack); // Overwriting the oldest snapshot frees what only it kept alive
+	}
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+	double bytes = (double)(CountedInt::live - before) * sizeof(NodeType) / history;
+	return { elapsed.count() / operations, bytes };
+}
+
+void benchmark(int history)
+{
+	std::cout << "Snapshots of a stack, keeping the last " << history << " for undo" << std::endl;
+	std::cout << "   Depth   Stack copy (ns/op, B/snapshot)   PersistentStack (ns/op, B/snapshot)" << std::endl;
+
+	for (int depth = 10; depth <= 100000; depth *= 10) {
+		int operations = std::max(history * 2, std::min(1000000, 5000000 / depth));
+
+		long long checksums[2] = { 0, 0 };
+		auto copies = benchmarkSnapshots<Stack<CountedInt>, Node<CountedInt>>(depth, operations, history, checksums[0]);
+		auto shared = benchmarkSnapshots<PersistentStack<CountedInt>, PersistentNode<CountedInt>>(depth, operations, history, checksums[1]);
+
+		std::cout << std::setw(8) << depth
+			<< std::setw(14) << copies.first << std::setw(12) << copies.second
+			<< std::setw(22) << shared.first << std::setw(12) << shared.second
+			<< (checksums[0] == checksums[1] ? "" : "  (results differ!)") << std::endl;
+	}
+}
+
+int main()
+{
+	PersistentStack<int> stack;
+	stack.push(10);
+	stack.push(20);
+
+	PersistentStack<int> snapshot = stack; // Shares both nodes
+	stack.push(30);
+	stack.pop();
+	stack.pop();
+
+	stack.display();    // 10
+	snapshot.display(); // 20 10
+
+	PersistentList<int> list = PersistentList<int>().cons(4).cons(3).cons(1);
+	PersistentList<int> edited = list.insertAtIndex(1, 2); // Copies 1, shares 3 and 4
+
+	list.display();   // 1 3 4
+	edited.display(); // 1 2 3 4
+	edited.deleteAtIndex(0).reverse().display(); // 4 3 2
+	std::cout << "Sum: " << edited.sum() << std::endl; // Sum: 10
+
+	benchmark(100);
+
+	return 0;
+}
@@ -0,0 +1,623 @@
+/**
+ * @file PersistentTree.cpp
+ *
+ * @brief Persistent (path-copying) binary search tree with lock-free readers. Nothing writes to a node after its
+ *        constructor: insert and erase copy the nodes on the path from the root to the change and build a new
+ *        root that shares every untouched subtree with the old one. The new root is published with one atomic
+ *        store, so a reader that loaded a root keeps searching a consistent version while the writer goes on.
+ *
+ *        The copied path is balanced the AVL way on the way back up. The rotations build new nodes instead of
+ *        changing the copies, so the height stays below 1.44 * log2(n). A write copies O(log n) nodes and
+ *        recurses O(log n) deep even when the keys arrive sorted.
+ *
+ *        The nodes that a write replaced are freed with epoch-based reclamation. Every reader announces the epoch
+ *        it started in, the writer tags the replaced nodes with the epoch they were unlinked in, and a batch of
+ *        nodes is only freed once no reader that may still see them is active.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 11:01
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+template <class T>
+class Node {
+public:
+
+	Node(T value, Node* left, Node* right)
+	{
+		this->value = value;
+		this->left = left;
+		this->right = right;
+		this->height = 1 + std::max(heightOf(left), heightOf(right));
+	}
+
+	static int heightOf(const Node* leaf) { return (leaf != nullptr) ? leaf->height : 0; }
+
+	T value;
+	Node* left;
+	Node* right;
+	int height; // Set from the children, LockedBinaryTree links children later and never reads it
+};
+
+/**
+ * Epoch announced by one reader thread. Each slot has its own cache line so readers do not slow each other down.
+ */
+class ReaderSlot {
+public:
+	static constexpr std::uint64_t idle = std::numeric_limits<std::uint64_t>::max();
+
+	alignas(64) std::atomic<std::uint64_t> epoch{idle};
+	std::atomic<bool> used{false};
+};
+
+/**
+ * Nodes replaced by one write, waiting until no reader can reach them anymore
+ */
+template <class T>
+class RetiredNodes {
+public:
+	std::uint64_t epoch; // Readers that announced this epoch or an older one may still see the nodes
+	std::vector<Node<T>*> nodes;
+};
+
+template <class T>
+class PersistentTree {
+public:
+	static constexpr int maxReaders = 128;
+
+	PersistentTree();
+	~PersistentTree();
+
+	PersistentTree(const PersistentTree&) = delete;
+	PersistentTree& operator=(const PersistentTree&) = delete;
+
+	void insert(T key);
+	bool erase(T key);
+
+	class Reader;
+	class Snapshot;
+
+private:
+	Node<T>* insert(T key, Node<T>* leaf, std::vector<Node<T>*>& replaced);
+	Node<T>* erase(T key, Node<T>* leaf, std::vector<Node<T>*>& replaced, bool& erased);
+	Node<T>* eraseMin(Node<T>* leaf, std::vector<Node<T>*>& replaced);
+	static Node<T>* balance(Node<T>* left, T value, Node<T>* right, std::vector<Node<T>*>& replaced);
+	void publish(Node<T>* newRoot, std::vector<Node<T>*>& replaced);
+	void reclaim();
+
+	std::atomic<Node<T>*> root;
+	alignas(64) std::atomic<std::uint64_t> epoch;
+	ReaderSlot readers[maxReaders];
+
+	std::mutex writeLock; // Writers take turns, readers never touch it
+	std::vector<RetiredNodes<T>> retired;
+	int writesSinceReclaim;
+};
+
+/**
+ * A version of the tree that stays valid, and unchanged, for as long as the snapshot lives. Searching it takes
+ * no locks. Only one snapshot per Reader may be alive at a time.
+ */
+template <class T>
+class PersistentTree<T>::Snapshot {
+public:
+	Snapshot(ReaderSlot& slot, const std::atomic<std::uint64_t>& epoch, const std::atomic<Node<T>*>& root)
+		: slot(slot)
+	{
+		slot.epoch.store(epoch.load()); // Announce the epoch before loading the root it protects
+		this->root = root.load();
+	}
+
+	~Snapshot()
+	{
+		slot.epoch.store(ReaderSlot::idle);
+	}
+
+	Snapshot(const Snapshot&) = delete;
+	Snapshot& operator=(const Snapshot&) = delete;
+
+	const Node<T>* search(T key) const
+	{
+		const Node<T>* leaf = root;
+		while (leaf != nullptr && !(key == leaf->value)) {
+			leaf = (key < leaf->value) ? leaf->left : leaf->right;
+		}
+		return leaf;
+	}
+
+	const Node<T>* top() const { return root; }
+	int height() const { return Node<T>::heightOf(root); }
+
+private:
+	ReaderSlot& slot;
+	Node<T>* root;
+};
+
+/**
+ * Registers a reader thread with the tree for as long as it lives. Each reading thread needs its own Reader, and
+ * at most maxReaders can exist at the same time: the constructor throws std::runtime_error when all slots are
+ * taken, so a Reader that exists can always be used.
+ */
+template <class T>
+class PersistentTree<T>::Reader {
+public:
+	Reader(PersistentTree& tree) : tree(tree), slot(nullptr)
+	{
+		for (ReaderSlot& candidate : tree.readers) {
+			bool expected = false;
+			if (candidate.used.compare_exchange_strong(expected, true)) {
+				slot = &candidate;
+				return;
+			}
+		}
+		throw std::runtime_error("More than " + std::to_string(maxReaders) + " readers of the same PersistentTree");
+	}
+
+	~Reader()
+	{
+		slot->used.store(false);
+	}
+
+	Reader(const Reader&) = delete;
+	Reader& operator=(const Reader&) = delete;
+
+	Snapshot snapshot() const
+	{
+		return Snapshot(*slot, tree.epoch, tree.root);
+	}
+
+	/**
+	 * Searches the latest published version of the tree
+	 *
+	 * @return true if key is in the tree
+	 */
+	bool contains(T key) const
+	{
+		Snapshot current = snapshot();
+		return current.search(key) != nullptr;
+	}
+
+private:
+	PersistentTree& tree;
+	ReaderSlot* slot;
+};
+
+template <class T>
+PersistentTree<T>::PersistentTree()
+{
+	this->root.store(nullptr);
+	this->epoch.store(0);
+	this->writesSinceReclaim = 0;
+}
+
+/**
+ * Frees the current version and everything still waiting to be reclaimed. No reader may be active.
+ */
+template <class T>
+PersistentTree<T>::~PersistentTree()
+{
+	for (RetiredNodes<T>& batch : retired) {
+		for (Node<T>* node : batch.nodes) {
+			delete node;
+		}
+	}
+
+	std::vector<Node<T>*> pending;
+	if (root.load() != nullptr) {
+		pending.push_back(root.load());
+	}
+
+	while (!pending.empty()) {
+		Node<T>* leaf = pending.back();
+		pending.pop_back();
+		if (leaf->left != nullptr) {
+			pending.push_back(leaf->left);
+		}
+		if (leaf->right != nullptr) {
+			pending.push_back(leaf->right);
+		}
+		delete leaf;
+	}
+}
+
+/**
+ * Builds a node with value between left and right, where the heights of left and right may differ by two after
+ * an insert or erase below. A single or double rotation is done by building new nodes from the grandchildren, so
+ * no node is changed after its constructor.
+ *
+ * @param replaced collects the nodes a rotation takes apart, copies from this write included
+ * @return the root of the balanced subtree
+ */
+template <class T>
+Node<T>* PersistentTree<T>::balance(Node<T>* left, T value, Node<T>* right, std::vector<Node<T>*>& replaced)
+{
+	int leftHeight = Node<T>::heightOf(left);
+	int rightHeight = Node<T>::heightOf(right);
+
+	if (leftHeight > rightHeight + 1) {
+		replaced.push_back(left);
+		if (Node<T>::heightOf(left->left) >= Node<T>::heightOf(left->right)) { // Rotate right
+			return new Node<T>(left->value, left->left, new Node<T>(value, left->right, right));
+		}
+
+		Node<T>* middle = left->right; // Rotate left->right to the top
+		replaced.push_back(middle);
+		return new Node<T>(middle->value, new Node<T>(left->value, left->left, middle->left),
+			new Node<T>(value, middle->right, right));
+	}
+
+	if (rightHeight > leftHeight + 1) {
+		replaced.push_back(right);
+		if (Node<T>::heightOf(right->right) >= Node<T>::heightOf(right->left)) { // Rotate left
+			return new Node<T>(right->value, new Node<T>(value, left, right->left), right->right);
+		}
+
+		Node<T>* middle = right->left; // Rotate right->left to the top
+		replaced.push_back(middle);
+		return new Node<T>(middle->value, new Node<T>(value, left, middle->left),
+			new Node<T>(right->value, middle->right, right->right));
+	}
+
+	return new Node<T>(value, left, right);
+}
+
+/**
+ * Copies the path down to where key goes and balances it on the way back. Recursive, the depth is bounded by
+ * the height of the tree, which is O(log n).
+ *
+ * @param replaced collects the old nodes on the path
+ * @return the copy of leaf
+ */
+template <class T>
+Node<T>* PersistentTree<T>::insert(T key, Node<T>* leaf, std::vector<Node<T>*>& replaced)
+{
+	if (leaf == nullptr) {
+		return new Node<T>(key, nullptr, nullptr);
+	}
+
+	replaced.push_back(leaf);
+
+	if (key < leaf->value) {
+		return balance(insert(key, leaf->left, replaced), leaf->value, leaf->right, replaced);
+	}
+
+	return balance(leaf->left, leaf->value, insert(key, leaf->right, replaced), replaced);
+}
+
+/**
+ * Copies the path down to the smallest node of a subtree and leaves that node out
+ *
+ * @return the copy of leaf without its smallest node
+ */
+template <class T>
+Node<T>* PersistentTree<T>::eraseMin(Node<T>* leaf, std::vector<Node<T>*>& replaced)
+{
+	replaced.push_back(leaf);
+
+	if (leaf->left == nullptr) {
+		return leaf->right;
+	}
+
+	return balance(eraseMin(leaf->left, replaced), leaf->value, leaf->right, replaced);
+}
+
+/**
+ * Copies the path down to key and leaves that node out. Nothing is copied when key is missing.
+ *
+ * @return the copy of leaf, or leaf itself if key is not below it
+ */
+template <class T>
+Node<T>* PersistentTree<T>::erase(T key, Node<T>* leaf, std::vector<Node<T>*>& replaced, bool& erased)
+{
+	if (leaf == nullptr) {
+		return nullptr;
+	}
+
+	if (key == leaf->value) {
+		erased = true;
+		replaced.push_back(leaf);
+
+		if (leaf->left == nullptr || leaf->right == nullptr) { // Zero or one child, the child takes its place
+			return (leaf->left != nullptr) ? leaf->left : leaf->right;
+		}
+
+		// Two children, the smallest value of the right subtree takes its place
+		Node<T>* successor = leaf->right;
+		while (successor->left != nullptr) {
+			successor = successor->left;
+		}
+
+		return balance(leaf->left, successor->value, eraseMin(leaf->right, replaced), replaced);
+	}
+
+	if (key < leaf->value) {
+		Node<T>* left = erase(key, leaf->left, replaced, erased);
+		if (!erased) {
+			return leaf;
+		}
+		replaced.push_back(leaf);
+		return balance(left, leaf->value, leaf->right, replaced);
+	}
+
+	Node<T>* right = erase(key, leaf->right, replaced, erased);
+	if (!erased) {
+		return leaf;
+	}
+	replaced.push_back(leaf);
+	return balance(leaf->left, leaf->value, right, replaced);
+}
+
+template <class T>
+void PersistentTree<T>::insert(T key)
+{
+	std::lock_guard<std::mutex> lock(writeLock);
+	std::vector<Node<T>*> replaced;
+	publish(insert(key, root.load(), replaced), replaced);
+}
+
+/**
+ * @return true if key was found and erased
+ */
+template <class T>
+bool PersistentTree<T>::erase(T key)
+{
+	std::lock_guard<std::mutex> lock(writeLock);
+	std::vector<Node<T>*> replaced;
+	bool erased = false;
+
+	Node<T>* newRoot = erase(key, root.load(), replaced, erased);
+	if (erased) {
+		publish(newRoot, replaced);
+	}
+
+	return erased;
+}
+
+/**
+ * Makes a new version visible to the readers and retires the nodes it no longer uses. A reader that announces a
+ * newer epoch than the one the nodes are tagged with loaded its root after the new one was stored, so it can
+ * not reach them.
+ */
+template <class T>
+void PersistentTree<T>::publish(Node<T>* newRoot, std::vector<Node<T>*>& replaced)
+{
+	root.store(newRoot);
+	std::uint64_t unlinked = epoch.fetch_add(1);
+
+	RetiredNodes<T> batch;
+	batch.epoch = unlinked;
+	batch.nodes.swap(replaced);
+	retired.push_back(std::move(batch));
+
+	if (++writesSinceReclaim >= 64) { // Scanning the reader slots on every write would cost more than it frees
+		writesSinceReclaim = 0;
+		reclaim();
+	}
+}
+
+/**
+ * Frees the retired nodes that every active reader started after
+ */
+template <class T>
+void PersistentTree<T>::reclaim()
+{
+	std::uint64_t oldest = ReaderSlot::idle;
+	for (ReaderSlot& slot : readers) {
+		oldest = std::min(oldest, slot.epoch.load());
+	}
+
+	std::size_t freed = 0;
+	while (freed < retired.size() && retired[freed].epoch < oldest) {
+		for (Node<T>* node : retired[freed].nodes) {
+			delete node;
+		}
+		freed++;
+	}
+
+	retired.erase(retired.begin(), retired.begin() + freed);
+}
+
+/**
+ * The tree from BinaryTreeQueue.cpp behind a reader/writer lock, so readers stop while a writer inserts.
+ * Used as the baseline in the benchmark.
+ */
+template <class T>
+class LockedBinaryTree {
+public:
+	LockedBinaryTree() { this->root = nullptr; }
+
+	~LockedBinaryTree() {
+		std::vector<Node<T>*> pending;
+		if (root != nullptr) {
+			pending.push_back(root);
+		}
+
+		while (!pending.empty()) {
+			Node<T>* leaf = pending.back();
+			pending.pop_back();
+			if (leaf->left != nullptr) {
+				pending.push_back(leaf->left);
+			}
+			if (leaf->right != nullptr) {
+				pending.push_back(leaf->right);
+			}
+			delete leaf;
+		}
+	}
+
+	void insert(T key) {
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		if (root == nullptr) {
+			root = new Node<T>(key, nullptr, nullptr);
+			return;
+		}
+
+		Node<T>* leaf = root;
+		for (;;) {
+			Node<T>*& child = (key < leaf->value) ? leaf->left : leaf->right;
+			if (child == nullptr) {
+				child = new Node<T>(key, nullptr, nullptr);
+				return;
+			}
+			leaf = child;
+		}
+	}
+
+	bool contains(T key) {
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		const Node<T>* leaf = root;
+		while (leaf != nullptr && !(key == leaf->value)) {
+			leaf = (key < leaf->value) ? leaf->left : leaf->right;
+		}
+		return leaf != nullptr;
+	}
+
+private:
+	std::shared_mutex mutex;
+	Node<T> *root;
+};
+
+/**
+ * Adapts LockedBinaryTree to the reader interface of PersistentTree
+ */
+template <class T>
+class LockedReader {
+public:
+	LockedReader(LockedBinaryTree<T>& tree) : tree(tree) {}
+
+	bool contains(T key) const { return tree.contains(key); }
+
+private:
+	LockedBinaryTree<T>& tree;
+};
+
+/**
+ * Lets reader threads search random keys while one writer keeps inserting, and reports the total amount of
+ * searches per second
+ *
+ * @param threads amount of reader threads
+ * @param keys amount of keys in the tree before the readers start
+ * @param sorted inserts the keys, and the writer's keys, in ascending order instead of at random
+ */
+template <class Tree, class Reader>
+double benchmark(int threads, int keys, bool sorted)
+{
+	Tree tree;
+	std::mt19937 random(42);
+	for (int i = 0; i < keys; i++) {
+		tree.insert(sorted ? 4 * i : (int)(random() % (4 * keys)));
+	}
+
+	std::atomic<bool> running(true);
+	std::atomic<long long> searches(0);
+	std::atomic<long long> found(0); // Summed up so the searches can not be optimized away
+	std::vector<std::thread> workers;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			Reader reader(tree);
+			std::mt19937 keyRandom(t);
+			long long done = 0;
+			long long hits = 0;
+			while (running.load(std::memory_order_relaxed)) {
+				for (int i = 0; i < 256; i++) {
+					hits += reader.contains((int)(keyRandom() % (4 * keys)));
+				}
+				done += 256;
+			}
+			searches += done;
+			found += hits;
+		});
+	}
+
+	std::thread writer([&]() {
+		std::mt19937 keyRandom(7);
+		int next = 4 * keys; // Sorted keys go on past the largest key in the tree
+		while (running.load(std::memory_order_relaxed)) {
+			tree.insert(sorted ? next++ : (int)(keyRandom() % (4 * keys)));
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	running = false;
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	writer.join();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (found == 0) {
+		std::cout << "No key was found!" << std::endl;
+	}
+
+	return searches / elapsed.count() / 1e6;
+}
+
+int main()
+{
+	PersistentTree<int> tree;
+	PersistentTree<int>::Reader reader(tree);
+
+	for (int i = 1; i <= 10; i++) {
+		tree.insert(i * 10);
+	}
+
+	{
+		PersistentTree<int>::Snapshot before = reader.snapshot();
+
+		tree.erase(50);
+		tree.insert(55);
+
+		// The snapshot still sees the version it was taken from
+		std::cout << (before.search(50) != nullptr) << " " << (before.search(55) != nullptr) << std::endl; // 1 0
+	}
+
+	std::cout << reader.contains(50) << " " << reader.contains(55) << std::endl; // 0 1
+
+	{
+		PersistentTree<int> sortedTree;
+		PersistentTree<int>::Reader sortedReader(sortedTree);
+		for (int i = 0; i < 1000000; i++) {
+			sortedTree.insert(i);
+		}
+		std::cout << "Height after 1000000 sorted inserts: " << sortedReader.snapshot().height() << std::endl; // 20
+	}
+
+	// Sorted keys turn LockedBinaryTree into a linked list, so that case gets fewer keys to finish in time
+	const struct { const char* name; int keys; bool sorted; } cases[] = {
+		{ "Random keys", 100000, false },
+		{ "Sorted keys", 10000, true },
+	};
+
+	for (const auto& test : cases) {
+		std::cout << test.name << ", " << test.keys << " in the tree" << std::endl;
+		std::cout << "Readers  LockedBinaryTree  PersistentTree  (M searches/s)" << std::endl;
+		for (int threads = 1; threads <= 64; threads *= 2) {
+			double lockedRate = benchmark<LockedBinaryTree<int>, LockedReader<int>>(threads, test.keys, test.sorted);
+			double persistentRate = benchmark<PersistentTree<int>, PersistentTree<int>::Reader>(threads, test.keys, test.sorted);
+
+			std::cout << std::setw(7) << threads << std::setw(18) << lockedRate << std::setw(16) << persistentRate << std::endl;
+		}
+	}
+
+	return 0;
+}
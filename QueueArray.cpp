@@ -1,89 +1,212 @@
 /**
  * @file QueueArray.cpp
  *
- * @brief Array-based queue without circular movement. Disadvantages: Once a space in the queue has been used, it can not be re-used.
+ * @brief Array-based queue built from fixed-size segments. The segments are chained together like the block map
+ *        of std::deque, so the queue grows when it runs out of space and every segment that has been drained
+ *        is recycled for later enqueues. Both enqueue and dequeue are O(1).
  *
  * @author Robin Viktorsson (robvik@hotmail.com)
  *
  * @date 2020-04-13 10:28
  */
- 
+
 #include <iostream>
+#include <optional>
+#include <utility>
 
-class Queue
+/**
+ * Fixed-size block of queue slots
+ */
+template <class T>
+class Segment
 {
 public:
-	Queue() {
-		this->front = -1;
-		this->rear = -1;
-		this->size = 10;
-		this->Q = new int[size];
+	Segment(int size) {
+		this->Q = new T[size];
+		this->next = nullptr;
 	}
 
-	Queue(int size) {
-		this->front = -1;
-		this->rear = -1;
-		this->size = size;
-		this->Q = new int[size];
+	~Segment() {
+		delete[] this->Q;
+	}
+
+	T *Q;
+	Segment* next;
+};
+
+template <class T>
+class Queue
+{
+public:
+	Queue() : Queue(64) {}
+
+	Queue(int segmentSize) {
+		this->segmentSize = segmentSize;
+		this->front = 0;
+		this->rear = 0;
+		this->count = 0;
+		this->head = new Segment<T>(segmentSize);
+		this->tail = this->head;
+		this->spare = nullptr;
 	}
 
 	~Queue() {
-		delete this->Q;
+		release(head);
+		release(spare);
 	}
 
-	void enqueue(int x);
-	int dequeue();
+	void enqueue(T value);
+	std::optional<T> dequeue();
 	void display();
+	bool isEmpty();
+	int size();
 
 private:
-	int front;
-	int rear;
-	int size;
-	int *Q;
+	Segment<T>* acquire();
+	void recycle(Segment<T>* segment);
+	void release(Segment<T>* segment);
+
+	int segmentSize;
+	int front; // Next slot to dequeue in the head segment
+	int rear;  // Next free slot in the tail segment
+	int count;
+	Segment<T>* head;
+	Segment<T>* tail;
+	Segment<T>* spare; // Drained segments waiting to be re-used
 };
 
 /**
- * Enqueues elements to the rear of the queue
+ * Gets an empty segment, re-using a drained one if there is any
  *
- * @param the value to add to the queue
+ * @return an unlinked segment
  */
-void Queue::enqueue(int value)
+template <class T>
+Segment<T>* Queue<T>::acquire()
 {
-	if (rear == (size - 1)) {
-		std::cout << "Queue is full." << std::endl;
+	if (spare == nullptr) {
+		return new Segment<T>(segmentSize);
 	}
-	else {
-		rear++;
-		Q[rear] = value;
+
+	Segment<T>* segment = spare;
+	spare = spare->next;
+	segment->next = nullptr;
+	return segment;
+}
+
+/**
+ * Puts a drained segment on the spare list
+ *
+ * @param segment the segment that no longer holds any values
+ */
+template <class T>
+void Queue<T>::recycle(Segment<T>* segment)
+{
+	segment->next = spare;
+	spare = segment;
+}
+
+/**
+ * Frees a chain of segments
+ *
+ * @param segment the first segment of the chain
+ */
+template <class T>
+void Queue<T>::release(Segment<T>* segment)
+{
+	while (segment != nullptr) {
+		Segment<T>* next = segment->next;
+		delete segment;
+		segment = next;
 	}
 }
 
 /**
- * Dequeues elements from the front in the queue
+ * Enqueues elements to the rear of the queue. A new segment is linked in when the tail segment is full.
  *
- * @return The position of the element value that was removed or -1 if the queue is empty
+ * @param the value to add to the queue
  */
-int Queue::dequeue()
+template <class T>
+void Queue<T>::enqueue(T value)
 {
-	int x = -1;
-	if (front == rear) {
-		std::cout << "Queue is empty." << std::endl;
+	if (rear == segmentSize) {
+		tail->next = acquire();
+		tail = tail->next;
+		rear = 0;
 	}
-	else {
-		x = Q[front + 1];
-		front++;
+
+	tail->Q[rear] = std::move(value);
+	rear++;
+	count++;
+}
+
+/**
+ * Dequeues elements from the front in the queue. The head segment is recycled once it has been drained.
+ *
+ * @return the dequeued value or std::nullopt if the queue is empty
+ */
+template <class T>
+std::optional<T> Queue<T>::dequeue()
+{
+	if (isEmpty()) {
+		return std::nullopt;
 	}
 
-	return x;
+	std::optional<T> value = std::move(head->Q[front]);
+	front++;
+	count--;
+
+	if (count == 0) { // The queue is empty, start over from the beginning of the segment
+		front = 0;
+		rear = 0;
+	} else if (front == segmentSize) { // The head segment is drained, move on to the next one
+		Segment<T>* drained = head;
+		head = head->next;
+		recycle(drained);
+		front = 0;
+	}
+
+	return value;
+}
+
+/**
+ * Check if the queue is empty
+ *
+ * @return true if empty, otherwise false
+ */
+template <class T>
+bool Queue<T>::isEmpty()
+{
+	return count == 0;
+}
+
+/**
+ * Amount of values in the queue
+ *
+ * @return the amount of values
+ */
+template <class T>
+int Queue<T>::size()
+{
+	return count;
 }
 
 /**
  * Displays elements in the queue with values
  */
-void Queue::display()
+template <class T>
+void Queue<T>::display()
 {
-	for (int i = front + 1; i <= rear; i++) {
-		std::cout << Q[i] << " ";
+	int index = front;
+	Segment<T>* segment = head;
+
+	for (int i = 0; i < count; i++) {
+		if (index == segmentSize) {
+			segment = segment->next;
+			index = 0;
+		}
+
+		std::cout << segment->Q[index] << " ";
+		index++;
 	}
 
 	std::cout << std::endl;
@@ -91,19 +214,24 @@ void Queue::display()
 
 int main()
 {
-	Queue q(5); // [  ][  ][  ][  ][  ]
+	Queue<int> q(2); // [  ][  ]
 
-	q.dequeue();   // Not possible - Queue is empty.
-	q.enqueue(10); // [10][  ][  ][  ][  ]
-	q.enqueue(20); // [10][20][  ][  ][  ]
-	q.enqueue(30); // [10][20][30][  ][  ]
-	q.dequeue();   // [  ][20][30][  ][  ]
-	q.dequeue();   // [  ][  ][30][  ][  ]
-	q.enqueue(40); // [  ][  ][30][40][  ]
-	q.enqueue(50); // [  ][  ][30][40][50]
-	q.enqueue(60); // Not possible - Queue is full.
+	if (!q.dequeue()) {
+		std::cout << "Queue is empty." << std::endl;
+	}
 
-	q.display();   // 30 40 50
+	q.enqueue(10); // [10][  ]
+	q.enqueue(20); // [10][20]
+	q.enqueue(30); // [10][20] -> [30][  ]
+	q.dequeue();   // [  ][20] -> [30][  ]
+	q.dequeue();   // [30][  ]            First segment is drained and recycled
+	q.enqueue(40); // [30][40]
+	q.enqueue(50); // [30][40] -> [50][  ] The recycled segment is re-used
+	q.enqueue(60); // [30][40] -> [50][60]
+
+	q.display();   // 30 40 50 60
+
+	std::cout << "Amount of values in the queue: " << q.size() << std::endl; // 4
 
 	return 0;
-}
\ No newline at end of file
+}
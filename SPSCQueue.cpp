@@ -0,0 +1,251 @@
+/**
+ * @file SPSCQueue.cpp
+ *
+ * @brief Lock-free single-producer/single-consumer circular queue. One thread enqueues and one thread dequeues,
+ *        so the queue only needs acquire/release atomics on the head and tail counters instead of a mutex.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 10:55
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+
+constexpr std::size_t cacheLineSize = 64;
+
+/**
+ * Rounds a capacity up to the next power of two
+ *
+ * @param value the requested capacity
+ * @return the smallest power of two that is greater than or equal to value
+ */
+constexpr std::size_t roundUpPowerOfTwo(std::size_t value)
+{
+	std::size_t power = 1;
+	while (power < value) {
+		power <<= 1;
+	}
+
+	return power;
+}
+
+/**
+ * The consumer owns head and the producer owns tail. Each of them sits on its own cache line together with a
+ * cached copy of the other side's counter. The cached copy is only refreshed from the shared atomic when the
+ * queue looks full (producer) or empty (consumer), so most operations never touch the other core's line.
+ */
+template <class T, std::size_t Capacity>
+class SPSCQueue
+{
+public:
+	static constexpr std::size_t size = roundUpPowerOfTwo(Capacity);
+	static constexpr std::size_t mask = size - 1;
+
+	SPSCQueue() {
+		this->head.store(0, std::memory_order_relaxed);
+		this->tail.store(0, std::memory_order_relaxed);
+		this->cachedHead = 0;
+		this->cachedTail = 0;
+	}
+
+	bool enqueue(const T& value); // Producer thread only
+	bool dequeue(T& value);       // Consumer thread only
+	bool isEmpty() const;
+
+private:
+	// Consumer side
+	alignas(cacheLineSize) std::atomic<std::size_t> head;
+	std::size_t cachedTail;
+
+	// Producer side
+	alignas(cacheLineSize) std::atomic<std::size_t> tail;
+	std::size_t cachedHead;
+
+	alignas(cacheLineSize) T Q[size];
+};
+
+/**
+ * Enqueues value in the queue. Must only be called from the producer thread.
+ *
+ * @param value to insert into the queue
+ * @return true if the value was inserted, false if the queue is full
+ */
+template <class T, std::size_t Capacity>
+bool SPSCQueue<T, Capacity>::enqueue(const T& value)
+{
+	std::size_t t = tail.load(std::memory_order_relaxed);
+
+	if (t - cachedHead == size) { // Looks full, check how far the consumer has come
+		cachedHead = head.load(std::memory_order_acquire);
+		if (t - cachedHead == size) {
+			return false;
+		}
+	}
+
+	Q[t & mask] = value;
+	tail.store(t + 1, std::memory_order_release); // Publish the value to the consumer
+	return true;
+}
+
+/**
+ * Dequeues value from the queue. Must only be called from the consumer thread.
+ *
+ * @param value is set to the dequeued value
+ * @return true if a value was dequeued, false if the queue is empty
+ */
+template <class T, std::size_t Capacity>
+bool SPSCQueue<T, Capacity>::dequeue(T& value)
+{
+	std::size_t h = head.load(std::memory_order_relaxed);
+
+	if (h == cachedTail) { // Looks empty, check how far the producer has come
+		cachedTail = tail.load(std::memory_order_acquire);
+		if (h == cachedTail) {
+			return false;
+		}
+	}
+
+	value = Q[h & mask];
+	head.store(h + 1, std::memory_order_release); // Hand the slot back to the producer
+	return true;
+}
+
+template <class T, std::size_t Capacity>
+bool SPSCQueue<T, Capacity>::isEmpty() const
+{
+	return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+}
+
+/**
+ * Pins the calling thread to a CPU. Pinning is skipped when the amount of CPUs is unknown, and a failure is
+ * reported; either way the benchmark still runs, just without the pinning.
+ *
+ * @param cpu the index of the CPU, wrapped around the amount of CPUs
+ * @return true if the thread was pinned
+ */
+bool pinThread(int cpu)
+{
+	unsigned cpus = std::thread::hardware_concurrency();
+	if (cpus == 0) {
+		return false;
+	}
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu % cpus, &set);
+
+	int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (result != 0) {
+		std::cout << "Could not pin thread to CPU " << cpu % cpus << ": " << std::strerror(result) << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Called after a failed enqueue/dequeue in the benchmarks. Spins for a while and then gives up the time slice,
+ * so the benchmarks still make progress when both threads end up on the same CPU.
+ */
+void backoff(int& spins)
+{
+	if (++spins > 64) {
+		std::this_thread::yield();
+		spins = 0;
+	}
+}
+
+/**
+ * Streams messages from a producer thread to a consumer thread and reports messages per second
+ */
+void benchmarkThroughput(long long messages)
+{
+	static SPSCQueue<long long, 4096> queue;
+	long long checksum = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::thread consumer([&]() {
+		pinThread(1);
+		long long value;
+		for (long long i = 0; i < messages; i++) {
+			int spins = 0;
+			while (!queue.dequeue(value)) { backoff(spins); }
+			checksum += value;
+		}
+	});
+
+	pinThread(0);
+	for (long long i = 0; i < messages; i++) {
+		int spins = 0;
+		while (!queue.enqueue(i)) { backoff(spins); }
+	}
+
+	consumer.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::cout << "Throughput: " << messages / elapsed.count() / 1e6 << " M messages/s";
+	std::cout << (checksum == messages * (messages - 1) / 2 ? "" : " (checksum mismatch!)") << std::endl;
+}
+
+/**
+ * Bounces a message between two threads through a pair of queues and reports the average round-trip time
+ */
+void benchmarkLatency(int roundTrips)
+{
+	static SPSCQueue<int, 64> ping;
+	static SPSCQueue<int, 64> pong;
+
+	std::thread echo([&]() {
+		pinThread(1);
+		int value;
+		for (int i = 0; i < roundTrips; i++) {
+			int spins = 0;
+			while (!ping.dequeue(value)) { backoff(spins); }
+			while (!pong.enqueue(value)) { backoff(spins); }
+		}
+	});
+
+	pinThread(0);
+	auto start = std::chrono::steady_clock::now();
+	int value;
+	for (int i = 0; i < roundTrips; i++) {
+		int spins = 0;
+		while (!ping.enqueue(i)) { backoff(spins); }
+		while (!pong.dequeue(value)) { backoff(spins); }
+	}
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+	echo.join();
+
+	std::cout << "Round-trip latency: " << elapsed.count() / roundTrips << " ns" << std::endl;
+}
+
+int main()
+{
+	SPSCQueue<int, 5> q; // Capacity is rounded up to 8
+
+	for (int i = 1; i <= 9; i++) {
+		if (!q.enqueue(i * 10)) {
+			std::cout << "Queue is full, " << i * 10 << " was not inserted" << std::endl;
+		}
+	}
+
+	int value;
+	while (q.dequeue(value)) {
+		std::cout << value << " "; // 10 20 30 40 50 60 70 80
+	}
+	std::cout << std::endl;
+
+	benchmarkThroughput(20000000);
+	benchmarkLatency(200000);
+
+	return 0;
+}
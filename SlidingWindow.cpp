@@ -0,0 +1,363 @@
+/**
+ * @file SlidingWindow.cpp
+ *
+ * @brief FIFO queue that keeps the aggregate of its values (sum, min, max or any other associative operation) up
+ *        to date, for rolling statistics over a stream. It is built from two array stacks: values are pushed on
+ *        the back stack, which only keeps the running aggregate of its values, and popped from the front stack,
+ *        where every entry keeps the aggregate of itself and every newer entry below it. When the front stack is
+ *        empty the back stack is flipped over onto it.
+ *
+ *        The aggregate of the window is the front stack's top aggregate combined with the back stack's running
+ *        aggregate, so query is O(1). Push is O(1), and pop is O(1) amortized: every value is flipped once. The
+ *        operation only needs to be associative, not commutative, as the values are always combined oldest first.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 11:10
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <utility>
+
+/**
+ * Sum of the values, 0 for an empty window
+ */
+template <class T>
+class SumMonoid {
+public:
+	using Value = T;
+
+	static T identity() { return T(); }
+	static T combine(const T& older, const T& newer) { return older + newer; }
+};
+
+/**
+ * Smallest value, the largest possible value for an empty window
+ */
+template <class T>
+class MinMonoid {
+public:
+	using Value = T;
+
+	static T identity() { return std::numeric_limits<T>::max(); }
+	static T combine(const T& older, const T& newer) { return std::min(older, newer); }
+};
+
+/**
+ * Largest value, the smallest possible value for an empty window
+ */
+template <class T>
+class MaxMonoid {
+public:
+	using Value = T;
+
+	static T identity() { return std::numeric_limits<T>::lowest(); }
+	static T combine(const T& older, const T& newer) { return std::max(older, newer); }
+};
+
+/**
+ * Entry of an AggregateStack: a value and the aggregate that belongs to it
+ */
+template <class T>
+class AggregateEntry {
+public:
+	T value;
+	T aggregate;
+};
+
+/**
+ * Array-based stack like Stack<T> from StackArray.cpp, but it grows instead of refusing values when it is full
+ * and every entry has room for an aggregate next to its value
+ */
+template <class T>
+class AggregateStack {
+public:
+	AggregateStack() {
+		this->size = 16;
+		this->top = -1;
+		this->stack = new AggregateEntry<T>[this->size];
+	}
+
+	~AggregateStack() {
+		delete[] this->stack;
+	}
+
+	AggregateStack(const AggregateStack&) = delete;
+	AggregateStack& operator=(const AggregateStack&) = delete;
+
+	void push(const T& value, const T& aggregate) {
+		if (top == size - 1) {
+			AggregateEntry<T>* bigger = new AggregateEntry<T>[size * 2];
+			std::move(stack, stack + size, bigger);
+			delete[] stack;
+			stack = bigger;
+			size *= 2;
+		}
+
+		top++;
+		stack[top].value = value;
+		stack[top].aggregate = aggregate;
+	}
+
+	void pop() { top--; }
+	void clear() { top = -1; }
+
+	const AggregateEntry<T>& peek() const { return stack[top]; }
+	const AggregateEntry<T>& at(int index) const { return stack[index]; } // 0 is the bottom
+
+	bool isEmpty() const { return top == -1; }
+	int count() const { return top + 1; }
+
+private:
+	AggregateEntry<T> *stack;
+	int size;
+	int top;
+};
+
+template <class Monoid>
+class SlidingWindow {
+public:
+	using Value = typename Monoid::Value;
+
+	SlidingWindow() {
+		this->backAggregate = Monoid::identity();
+	}
+
+	void push(const Value& value);
+	std::optional<Value> pop();
+	Value query() const;
+
+	bool isEmpty() const;
+	int count() const;
+
+private:
+	void flip();
+
+	AggregateStack<Value> front; // Oldest value on top, its aggregate covers the whole front stack
+	AggregateStack<Value> back;  // Newest value on top, the aggregates are not used
+	Value backAggregate;         // Aggregate of the whole back stack
+};
+
+/**
+ * Adds value as the newest value of the window
+ */
+template <class Monoid>
+void SlidingWindow<Monoid>::push(const Value& value)
+{
+	back.push(value, value);
+	backAggregate = Monoid::combine(backAggregate, value);
+}
+
+/**
+ * Moves the back stack onto the front stack, newest value first, so the oldest value ends up on top. Each entry
+ * gets the aggregate of itself and the newer values already moved.
+ */
+template <class Monoid>
+void SlidingWindow<Monoid>::flip()
+{
+	for (int i = back.count() - 1; i >= 0; i--) {
+		const Value& value = back.at(i).value;
+		front.push(value, front.isEmpty() ? value : Monoid::combine(value, front.peek().aggregate));
+	}
+
+	back.clear();
+	backAggregate = Monoid::identity();
+}
+
+/**
+ * Removes the oldest value of the window
+ *
+ * @return the removed value or std::nullopt if the window is empty
+ */
+template <class Monoid>
+std::optional<typename Monoid::Value> SlidingWindow<Monoid>::pop()
+{
+	if (front.isEmpty()) {
+		if (back.isEmpty()) {
+			return std::nullopt;
+		}
+		flip();
+	}
+
+	std::optional<Value> value = front.peek().value;
+	front.pop();
+	return value;
+}
+
+/**
+ * The aggregate of all values in the window, oldest first
+ *
+ * @return the aggregate or the identity of the monoid if the window is empty
+ */
+template <class Monoid>
+typename Monoid::Value SlidingWindow<Monoid>::query() const
+{
+	if (front.isEmpty()) {
+		return backAggregate;
+	}
+
+	return Monoid::combine(front.peek().aggregate, backAggregate);
+}
+
+template <class Monoid>
+bool SlidingWindow<Monoid>::isEmpty() const
+{
+	return front.isEmpty() && back.isEmpty();
+}
+
+template <class Monoid>
+int SlidingWindow<Monoid>::count() const
+{
+	return front.count() + back.count();
+}
+
+/**
+ * Running mean as a custom monoid: the sum and the count are combined separately
+ */
+class Mean {
+public:
+	double sum;
+	long long count;
+
+	double value() const { return count == 0 ? 0.0 : sum / count; }
+};
+
+class MeanMonoid {
+public:
+	using Value = Mean;
+
+	static Mean identity() { return Mean{ 0.0, 0 }; }
+	static Mean combine(const Mean& older, const Mean& newer) { return Mean{ older.sum + newer.sum, older.count + newer.count }; }
+};
+
+/**
+ * Circular queue like the one in CircularQueue.cpp that scans the whole window for every query, the way rolling
+ * aggregates were computed before. Used as the baseline in the benchmark.
+ */
+template <class Monoid>
+class RescanWindow {
+public:
+	using Value = typename Monoid::Value;
+
+	RescanWindow(int capacity) {
+		this->size = capacity;
+		this->front = 0;
+		this->length = 0;
+		this->Q = new Value[capacity];
+	}
+
+	~RescanWindow() {
+		delete[] this->Q;
+	}
+
+	RescanWindow(const RescanWindow&) = delete;
+	RescanWindow& operator=(const RescanWindow&) = delete;
+
+	void push(const Value& value) {
+		Q[(front + length) % size] = value;
+		length++;
+	}
+
+	std::optional<Value> pop() {
+		if (length == 0) {
+			return std::nullopt;
+		}
+		Value value = Q[front];
+		front = (front + 1) % size;
+		length--;
+		return value;
+	}
+
+	Value query() const {
+		Value aggregate = Monoid::identity();
+		for (int i = 0; i < length; i++) {
+			aggregate = Monoid::combine(aggregate, Q[(front + i) % size]);
+		}
+		return aggregate;
+	}
+
+	int count() const { return length; }
+
+private:
+	Value *Q;
+	int size;
+	int front;
+	int length;
+};
+
+/**
+ * Slides a window over a stream of random values and queries the aggregate after every value
+ *
+ * @return nanoseconds per value
+ */
+template <class Window>
+double benchmarkWindow(Window& window, int width, int values, long long& checksum)
+{
+	std::mt19937 random(42);
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < values; i++) {
+		window.push((int)(random() % 1000000));
+		if (window.count() > width) {
+			window.pop();
+		}
+		checksum += window.query();
+	}
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+	return elapsed.count() / values;
+}
+
+template <class Monoid>
+void benchmark(const char* name)
+{
+	std::cout << name << std::endl;
+	std::cout << "  Window  RescanWindow  SlidingWindow  (ns per value)" << std::endl;
+
+	for (int width = 10; width <= 10000; width *= 10) {
+		int values = std::max(2 * width, std::min(2000000, 200000000 / width)); // Keeps the rescans from taking minutes
+
+		long long checksums[2] = { 0, 0 };
+		RescanWindow<Monoid> rescan(width + 1);
+		SlidingWindow<Monoid> sliding;
+
+		double rescanTime = benchmarkWindow(rescan, width, values, checksums[0]);
+		double slidingTime = benchmarkWindow(sliding, width, values, checksums[1]);
+
+		std::cout << std::setw(8) << width << std::setw(14) << rescanTime << std::setw(15) << slidingTime
+			<< (checksums[0] == checksums[1] ? "" : "  (results differ!)") << std::endl;
+	}
+}
+
+int main()
+{
+	SlidingWindow<MaxMonoid<int>> window;
+
+	for (int value : { 3, 1, 4, 1, 5, 9, 2, 6 }) {
+		window.push(value);
+		if (window.count() > 3) {
+			window.pop();
+		}
+		std::cout << window.query() << " "; // 3 3 4 4 5 9 9 9
+	}
+	std::cout << std::endl;
+
+	SlidingWindow<MeanMonoid> latency;
+	latency.push(Mean{ 12.0, 1 });
+	latency.push(Mean{ 18.0, 1 });
+	latency.push(Mean{ 30.0, 1 });
+	latency.pop();
+	std::cout << "Mean of the last two: " << latency.query().value() << std::endl; // 24
+
+	benchmark<SumMonoid<long long>>("Sum");
+	benchmark<MinMonoid<int>>("Min");
+	benchmark<MaxMonoid<int>>("Max");
+
+	return 0;
+}
@@ -0,0 +1,336 @@
+/**
+ * @file TelemetryRing.cpp
+ *
+ * @brief Circular queue in overwrite-oldest mode, for recording trace events into a fixed amount of memory.
+ *        When the ring is full the oldest entry is overwritten instead of the new value being dropped. Writers
+ *        never take a lock: each one takes a position with a single fetch_add and writes its slot.
+ *
+ *        Two writers meet in a slot only when the ring wraps around while one of them is still copying. The
+ *        newer position always wins: a writer that finds the slot still being written by the writer one lap
+ *        behind waits for that copy to finish and then overwrites it, and a writer that finds a newer position
+ *        already in its slot has been lapped and drops its value, which is older than what the slot holds.
+ *
+ *        Every slot carries a seqlock-style version. It is odd while a writer is busy with the slot and even
+ *        (2 * position + 2) once the value for that position is complete, so a reader can copy a slot and tell
+ *        afterwards if it was overwritten while copying. Readers take snapshots without stopping the writers.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 10:55
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A slot in the ring. The value is kept as atomic words so readers may copy it while a writer overwrites it;
+ * the version tells them afterwards if that happened.
+ */
+template <class T>
+class Slot
+{
+public:
+	static constexpr std::size_t words = (sizeof(T) + 7) / 8;
+
+	std::atomic<std::uint64_t> version{0};
+	std::atomic<std::uint64_t> data[words];
+};
+
+template <class T>
+class TelemetryRing
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Values are copied word by word");
+
+public:
+	TelemetryRing(std::size_t capacity) {
+		this->size = 1;
+		while (this->size < capacity) {
+			this->size <<= 1;
+		}
+		this->mask = this->size - 1;
+		this->Q = new Slot<T>[this->size];
+		this->writePos.store(0, std::memory_order_relaxed);
+		this->lost.store(0, std::memory_order_relaxed);
+	}
+
+	~TelemetryRing() {
+		delete[] this->Q;
+	}
+
+	TelemetryRing(const TelemetryRing&) = delete;
+	TelemetryRing& operator=(const TelemetryRing&) = delete;
+
+	bool record(const T& value);
+	std::uint64_t snapshot(std::vector<T>& values) const;
+	std::uint64_t written() const;
+	std::uint64_t dropped() const;
+
+private:
+	Slot<T> *Q;
+	std::size_t size;
+	std::size_t mask;
+
+	alignas(64) std::atomic<std::uint64_t> writePos;
+	alignas(64) std::atomic<std::uint64_t> lost;
+};
+
+/**
+ * Records value, overwriting the oldest entry when the ring is full. Safe to call from any number of threads.
+ *
+ * If the slot is still being written for an older position, the writer waits for that copy to finish, so the
+ * older value cannot end up replacing this newer one. A writer that has been lapped by the ring (another writer
+ * already claimed the same slot for a newer position) drops its value, and the drop is counted. These are the
+ * only two cases where a writer does not write right away, and both need the ring to wrap around during a copy.
+ *
+ * @param value to record
+ * @return true if the value was written, false if it was dropped
+ */
+template <class T>
+bool TelemetryRing<T>::record(const T& value)
+{
+	std::uint64_t pos = writePos.fetch_add(1, std::memory_order_relaxed);
+	Slot<T>& slot = Q[pos & mask];
+
+	std::uint64_t version = slot.version.load(std::memory_order_relaxed);
+	int spins = 0;
+	while (true) {
+		if (version > 2 * pos) { // Lapped, the slot already belongs to a newer position
+			lost.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		if (version & 1) { // The writer one lap behind is still copying, wait for it so the newer value wins
+			if (++spins > 64) {
+				std::this_thread::yield();
+				spins = 0;
+			}
+			version = slot.version.load(std::memory_order_relaxed);
+			continue;
+		}
+
+		if (slot.version.compare_exchange_weak(version, 2 * pos + 1, std::memory_order_relaxed)) {
+			break;
+		}
+	}
+
+	std::atomic_thread_fence(std::memory_order_release); // Readers must see the odd version before any new data
+
+	std::uint64_t words[Slot<T>::words] = {};
+	std::memcpy(words, &value, sizeof(T));
+	for (std::size_t i = 0; i < Slot<T>::words; i++) {
+		slot.data[i].store(words[i], std::memory_order_relaxed);
+	}
+
+	slot.version.store(2 * pos + 2, std::memory_order_release);
+	return true;
+}
+
+/**
+ * Copies the entries currently in the ring, oldest first, while the writers keep going. Entries that are
+ * overwritten or still being written while the snapshot is taken are left out, so every returned value is
+ * exactly what one writer recorded.
+ *
+ * @param values is filled with the entries
+ * @return the position of the first entry that was considered, i.e. the amount of older entries already lost
+ */
+template <class T>
+std::uint64_t TelemetryRing<T>::snapshot(std::vector<T>& values) const
+{
+	std::uint64_t end = writePos.load(std::memory_order_acquire);
+	std::uint64_t begin = (end > size) ? end - size : 0;
+
+	values.clear();
+	values.reserve(end - begin);
+
+	std::uint64_t words[Slot<T>::words];
+	for (std::uint64_t pos = begin; pos < end; pos++) {
+		const Slot<T>& slot = Q[pos & mask];
+
+		std::uint64_t before = slot.version.load(std::memory_order_acquire);
+		if (before != 2 * pos + 2) { // Not written yet, dropped or already overwritten
+			continue;
+		}
+
+		for (std::size_t i = 0; i < Slot<T>::words; i++) {
+			words[i] = slot.data[i].load(std::memory_order_relaxed);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.version.load(std::memory_order_relaxed) != before) { // Overwritten while copying
+			continue;
+		}
+
+		T value;
+		std::memcpy(&value, words, sizeof(T));
+		values.push_back(value);
+	}
+
+	return begin;
+}
+
+/**
+ * Amount of values recorded since the ring was created, including overwritten and dropped ones
+ */
+template <class T>
+std::uint64_t TelemetryRing<T>::written() const
+{
+	return writePos.load(std::memory_order_relaxed);
+}
+
+/**
+ * Amount of values dropped because their writer was lapped, i.e. a newer value already took their slot
+ */
+template <class T>
+std::uint64_t TelemetryRing<T>::dropped() const
+{
+	return lost.load(std::memory_order_relaxed);
+}
+
+/**
+ * Trace event used in the benchmark. The checksum lets the benchmark detect torn entries in snapshots.
+ */
+class Event
+{
+public:
+	std::uint64_t timestamp;
+	std::uint32_t thread;
+	std::uint32_t sequence;
+	std::uint64_t checksum;
+};
+
+std::uint64_t checksumOf(const Event& event)
+{
+	return event.timestamp * 31 + event.thread * 17 + event.sequence;
+}
+
+/**
+ * Large value for the stress test, so that copying one into the ring takes a while. Every word holds the same
+ * id, so a torn value has words that differ. record() and snapshot() copy it through a buffer on the stack,
+ * which is what keeps it at 2 MB.
+ */
+class LargeEvent
+{
+public:
+	std::uint64_t words[1 << 18];
+};
+
+/**
+ * Makes two writers meet in the same slot: an older writer starts copying a large value into a ring of one
+ * slot, and as soon as it has taken its position a newer writer records into the same slot. Whether the older
+ * copy is still running then depends on the scheduler, so this is repeated. Every round, the ring must end up
+ * holding the newer value, whole.
+ *
+ * @return true if the newer value won every round
+ */
+bool stressTest(int rounds)
+{
+	static LargeEvent older;
+	static LargeEvent newer;
+	std::fill(std::begin(older.words), std::end(older.words), 1);
+	std::fill(std::begin(newer.words), std::end(newer.words), 2);
+
+	int failures = 0;
+	std::vector<LargeEvent> values;
+
+	for (int round = 0; round < rounds; round++) {
+		TelemetryRing<LargeEvent> ring(1);
+
+		std::thread writer([&]() { ring.record(older); });
+		while (ring.written() == 0) {
+			std::this_thread::yield();
+		}
+		ring.record(newer);
+		writer.join();
+
+		ring.snapshot(values);
+		failures += values.size() != 1
+			|| std::count(std::begin(values[0].words), std::end(values[0].words), 2) != (long)std::size(values[0].words);
+	}
+
+	std::cout << "Stress test: " << (failures == 0 ? "passed" : "FAILED") << "\n";
+	return failures == 0;
+}
+
+/**
+ * Lets writer threads record events for a while and takes snapshots in the meantime
+ */
+void benchmark(int writers)
+{
+	TelemetryRing<Event> ring(1 << 16);
+	std::atomic<bool> running(true);
+	std::vector<std::thread> threads;
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int t = 0; t < writers; t++) {
+		threads.emplace_back([&, t]() {
+			std::uint32_t sequence = 0;
+			while (running.load(std::memory_order_relaxed)) {
+				Event event;
+				event.timestamp = std::chrono::steady_clock::now().time_since_epoch().count();
+				event.thread = t;
+				event.sequence = sequence++;
+				event.checksum = checksumOf(event);
+				ring.record(event);
+			}
+		});
+	}
+
+	std::vector<Event> events;
+	long long snapshots = 0;
+	long long torn = 0;
+
+	while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500)) {
+		ring.snapshot(events);
+		snapshots++;
+
+		for (const Event& event : events) {
+			torn += (event.checksum != checksumOf(event));
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+
+	running = false;
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::cout << writers << " writer(s): " << ring.written() / elapsed.count() / 1e6 << " M events/s, "
+		<< ring.dropped() << " dropped, " << snapshots << " snapshots, " << torn << " torn entries\n";
+}
+
+int main()
+{
+	TelemetryRing<int> ring(4);
+
+	for (int i = 1; i <= 6; i++) {
+		ring.record(i * 10); // 50 and 60 overwrite 10 and 20
+	}
+
+	std::vector<int> values;
+	std::uint64_t lost = ring.snapshot(values);
+
+	std::cout << "Overwritten: " << lost << "\n"; // 2
+	for (int value : values) {
+		std::cout << value << " "; // 30 40 50 60
+	}
+	std::cout << "\n";
+
+	stressTest(100);
+
+	benchmark(1);
+	benchmark(4);
+
+	return 0;
+}
@@ -0,0 +1,574 @@
+/**
+ * @file Treap.cpp
+ *
+ * @brief Treap: a binary search tree on the keys that is also a heap on random priorities, which keeps its
+ *        expected height at O(log n) whatever order the keys arrive in. Everything is built on two operations:
+ *        split, which cuts the tree into the keys below and above a key, and join, which glues two trees back
+ *        together when all keys of one are smaller than all keys of the other. Both walk one path, O(log n).
+ *
+ *        Union, intersection and difference of two treaps are divide and conquer on top of split and join: the
+ *        root of one tree splits the other one, and the two halves are combined independently. The halves are
+ *        handed to separate threads near the top of the recursion. For sets of sizes m <= n this is
+ *        O(m log(n / m + 1)) work instead of the O(m log n) of inserting one set into the other, and it runs in
+ *        parallel.
+ *
+ * @author Robin Viktorsson (robvik@hotmail.com)
+ *
+ * @date 2020-04-13 11:01
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+template <class T>
+class Node {
+public:
+
+	Node(T value, unsigned priority)
+	{
+		this->value = value;
+		this->priority = priority;
+		this->left = nullptr;
+		this->right = nullptr;
+	}
+
+	T value;
+	unsigned priority; // Higher than the priorities of every node below
+	Node* left;
+	Node* right;
+};
+
+template <class T>
+class Treap {
+public:
+	Treap();
+	Treap(Treap&& other);
+	Treap& operator=(Treap&& other);
+	~Treap();
+
+	Treap(const Treap&) = delete;
+	Treap& operator=(const Treap&) = delete;
+
+	bool insert(T key);
+	bool erase(T key);
+	Node<T>* search(T key);
+
+	Treap split(T key);
+	void join(Treap& greater);
+
+	void unionWith(Treap& other, int threads = std::thread::hardware_concurrency());
+	void intersectWith(Treap& other, int threads = std::thread::hardware_concurrency());
+	void difference(Treap& other, int threads = std::thread::hardware_concurrency());
+
+	template <class Visitor>
+	void forEach(Visitor visitor) const;
+	void display() const;
+
+private:
+	static void split(Node<T>* leaf, T key, Node<T>*& less, Node<T>*& equal, Node<T>*& greater);
+	static Node<T>* join(Node<T>* less, Node<T>* greater);
+	static Node<T>* unite(Node<T>* a, Node<T>* b, int threads);
+	static Node<T>* intersect(Node<T>* a, Node<T>* b, int threads);
+	static Node<T>* subtract(Node<T>* a, Node<T>* b, int threads);
+	static void destroy(Node<T>* leaf);
+
+	template <class Left, class Right>
+	static void both(int threads, Left left, Right right);
+
+	Node<T> *root;
+	std::mt19937 random; // Priorities of the inserted nodes
+};
+
+template <class T>
+Treap<T>::Treap()
+{
+	this->root = nullptr;
+	this->random.seed(std::random_device()());
+}
+
+template <class T>
+Treap<T>::Treap(Treap&& other)
+{
+	this->root = other.root;
+	this->random = std::move(other.random);
+	other.root = nullptr;
+}
+
+template <class T>
+Treap<T>& Treap<T>::operator=(Treap&& other)
+{
+	if (this != &other) {
+		destroy(root);
+		root = other.root;
+		random = std::move(other.random);
+		other.root = nullptr;
+	}
+	return *this;
+}
+
+template <class T>
+Treap<T>::~Treap()
+{
+	destroy(root);
+}
+
+// Recursive, the expected depth is O(log n)
+template <class T>
+void Treap<T>::destroy(Node<T>* leaf)
+{
+	if (leaf != nullptr) {
+		destroy(leaf->left);
+		destroy(leaf->right);
+		delete leaf;
+	}
+}
+
+/**
+ * Cuts a subtree into the keys below key, the node with key itself and the keys above key. The nodes are reused,
+ * only the links on the path down to key change.
+ *
+ * @param leaf the subtree to cut, it is consumed
+ * @param less receives the keys below key
+ * @param equal receives the node with key, or nullptr if there is none
+ * @param greater receives the keys above key
+ */
+template <class T>
+void Treap<T>::split(Node<T>* leaf, T key, Node<T>*& less, Node<T>*& equal, Node<T>*& greater)
+{
+	if (leaf == nullptr) {
+		less = nullptr;
+		equal = nullptr;
+		greater = nullptr;
+	} else if (key < leaf->value) {
+		split(leaf->left, key, less, equal, leaf->left);
+		greater = leaf;
+	} else if (leaf->value < key) {
+		split(leaf->right, key, leaf->right, equal, greater);
+		less = leaf;
+	} else {
+		less = leaf->left;
+		greater = leaf->right;
+		equal = leaf;
+		equal->left = nullptr;
+		equal->right = nullptr;
+	}
+}
+
+/**
+ * Glues two subtrees together. Every key in less must be smaller than every key in greater.
+ *
+ * @return the root of the joined subtree
+ */
+template <class T>
+Node<T>* Treap<T>::join(Node<T>* less, Node<T>* greater)
+{
+	if (less == nullptr) {
+		return greater;
+	}
+
+	if (greater == nullptr) {
+		return less;
+	}
+
+	if (less->priority > greater->priority) {
+		less->right = join(less->right, greater);
+		return less;
+	}
+
+	greater->left = join(less, greater->left);
+	return greater;
+}
+
+/**
+ * Runs two functions, on two threads if more than one thread is left for this part of the recursion
+ */
+template <class T>
+template <class Left, class Right>
+void Treap<T>::both(int threads, Left left, Right right)
+{
+	if (threads > 1) {
+		std::thread worker(left);
+		right();
+		worker.join();
+	} else {
+		left();
+		right();
+	}
+}
+
+/**
+ * @return true if key was inserted, false if it was already in the set
+ */
+template <class T>
+bool Treap<T>::insert(T key)
+{
+	Node<T>* less;
+	Node<T>* equal;
+	Node<T>* greater;
+	split(root, key, less, equal, greater);
+
+	bool inserted = (equal == nullptr);
+	if (inserted) {
+		equal = new Node<T>(key, random());
+	}
+
+	root = join(join(less, equal), greater);
+	return inserted;
+}
+
+/**
+ * @return true if key was found and erased
+ */
+template <class T>
+bool Treap<T>::erase(T key)
+{
+	Node<T>* less;
+	Node<T>* equal;
+	Node<T>* greater;
+	split(root, key, less, equal, greater);
+
+	bool erased = (equal != nullptr);
+	delete equal;
+	root = join(less, greater);
+	return erased;
+}
+
+template <class T>
+Node<T>* Treap<T>::search(T key)
+{
+	Node<T>* leaf = root;
+
+	while (leaf != nullptr && !(key == leaf->value)) {
+		leaf = (key < leaf->value) ? leaf->left : leaf->right;
+	}
+
+	return leaf;
+}
+
+/**
+ * Moves the keys greater than or equal to key into a new treap. O(log n).
+ *
+ * @return the treap with the keys from key up
+ */
+template <class T>
+Treap<T> Treap<T>::split(T key)
+{
+	Node<T>* less;
+	Node<T>* equal;
+	Node<T>* greater;
+	split(root, key, less, equal, greater);
+
+	Treap upper;
+	upper.root = join(equal, greater);
+	root = less;
+	return upper;
+}
+
+/**
+ * Moves all keys of greater into this treap, leaving greater empty. Every key in greater must be larger than
+ * every key here. O(log n).
+ */
+template <class T>
+void Treap<T>::join(Treap& greater)
+{
+	root = join(root, greater.root);
+	greater.root = nullptr;
+}
+
+// The root with the higher priority stays on top and splits the other tree
+template <class T>
+Node<T>* Treap<T>::unite(Node<T>* a, Node<T>* b, int threads)
+{
+	if (a == nullptr) {
+		return b;
+	}
+
+	if (b == nullptr) {
+		return a;
+	}
+
+	if (a->priority < b->priority) {
+		std::swap(a, b);
+	}
+
+	Node<T>* less;
+	Node<T>* equal;
+	Node<T>* greater;
+	split(b, a->value, less, equal, greater);
+	delete equal; // The key is already in a
+
+	Node<T>* left;
+	Node<T>* right;
+	both(threads,
+		[&]() { left = unite(a->left, less, threads / 2); },
+		[&]() { right = unite(a->right, greater, threads - threads / 2); });
+
+	a->left = left;
+	a->right = right;
+	return a;
+}
+
+template <class T>
+Node<T>* Treap<T>::intersect(Node<T>* a, Node<T>* b, int threads)
+{
+	if (a == nullptr || b == nullptr) {
+		destroy(a);
+		destroy(b);
+		return nullptr;
+	}
+
+	if (a->priority < b->priority) {
+		std::swap(a, b);
+	}
+
+	Node<T>* less;
+	Node<T>* equal;
+	Node<T>* greater;
+	split(b, a->value, less, equal, greater);
+
+	Node<T>* left;
+	Node<T>* right;
+	both(threads,
+		[&]() { left = intersect(a->left, less, threads / 2); },
+		[&]() { right = intersect(a->right, greater, threads - threads / 2); });
+
+	if (equal != nullptr) { // The key is in both, a stays
+		delete equal;
+		a->left = left;
+		a->right = right;
+		return a;
+	}
+
+	delete a;
+	return join(left, right);
+}
+
+// The keys of a that are not in b, b's root splits a
+template <class T>
+Node<T>* Treap<T>::subtract(Node<T>* a, Node<T>* b, int threads)
+{
+	if (a == nullptr) {
+		destroy(b);
+		return nullptr;
+	}
+
+	if (b == nullptr) {
+		return a;
+	}
+
+	Node<T>* less;
+	Node<T>* equal;
+	Node<T>* greater;
+	split(a, b->value, less, equal, greater);
+
+	Node<T>* left;
+	Node<T>* right;
+	both(threads,
+		[&]() { left = subtract(less, b->left, threads / 2); },
+		[&]() { right = subtract(greater, b->right, threads - threads / 2); });
+
+	delete equal;
+	delete b;
+	return join(left, right);
+}
+
+/**
+ * Adds the keys of other to this treap. Other is left empty, its nodes are reused or freed.
+ *
+ * @param threads amount of threads to spread the work over
+ */
+template <class T>
+void Treap<T>::unionWith(Treap& other, int threads)
+{
+	root = unite(root, other.root, threads);
+	other.root = nullptr;
+}
+
+/**
+ * Keeps only the keys that are also in other. Other is left empty, its nodes are reused or freed.
+ *
+ * @param threads amount of threads to spread the work over
+ */
+template <class T>
+void Treap<T>::intersectWith(Treap& other, int threads)
+{
+	root = intersect(root, other.root, threads);
+	other.root = nullptr;
+}
+
+/**
+ * Removes the keys that are in other. Other is left empty, its nodes are freed.
+ *
+ * @param threads amount of threads to spread the work over
+ */
+template <class T>
+void Treap<T>::difference(Treap& other, int threads)
+{
+	root = subtract(root, other.root, threads);
+	other.root = nullptr;
+}
+
+/**
+ * Visits all keys in order
+ *
+ * @param visitor is called with every key
+ */
+template <class T>
+template <class Visitor>
+void Treap<T>::forEach(Visitor visitor) const
+{
+	std::vector<Node<T>*> stack;
+	Node<T>* leaf = root;
+
+	while (leaf != nullptr || !stack.empty()) {
+		while (leaf != nullptr) {
+			stack.push_back(leaf);
+			leaf = leaf->left;
+		}
+
+		leaf = stack.back();
+		stack.pop_back();
+		visitor(leaf->value);
+		leaf = leaf->right;
+	}
+}
+
+template <class T>
+void Treap<T>::display() const
+{
+	forEach([](const T& key) { std::cout << key << " "; });
+	std::cout << std::endl;
+}
+
+std::vector<int> keysOf(const Treap<int>& treap)
+{
+	std::vector<int> keys;
+	treap.forEach([&](int key) { keys.push_back(key); });
+	return keys;
+}
+
+void fill(Treap<int>& treap, const std::vector<int>& keys)
+{
+	for (int key : keys) {
+		treap.insert(key);
+	}
+}
+
+/**
+ * Times one set operation done by inserting, searching or erasing the keys of one treap in the other, and done
+ * with split and join on each of the given amounts of threads. The treaps are rebuilt for every run because the
+ * operations consume them.
+ */
+template <class ByKey, class ByJoin>
+void benchmarkOperation(const char* name, const std::vector<int>& a, const std::vector<int>& b,
+	const std::vector<int>& threadCounts, ByKey byKey, ByJoin byJoin)
+{
+	int runs = 1 + (int)threadCounts.size();
+	std::vector<double> times(runs);
+	std::vector<std::vector<int>> results(runs);
+
+	for (int run = 0; run < runs; run++) {
+		Treap<int> first;
+		Treap<int> second;
+		fill(first, a);
+		fill(second, b);
+
+		auto start = std::chrono::steady_clock::now();
+		if (run == 0) {
+			byKey(first, second);
+		} else {
+			byJoin(first, second, threadCounts[run - 1]);
+		}
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		times[run] = elapsed.count();
+		results[run] = keysOf(first);
+	}
+
+	bool same = true;
+	std::cout << std::setw(12) << name;
+	for (int run = 0; run < runs; run++) {
+		std::cout << std::setw(16) << times[run];
+		same = same && results[run] == results[0];
+	}
+	std::cout << (same ? "" : "  (results differ!)") << std::endl;
+}
+
+void benchmark(int n)
+{
+	std::mt19937 random(42);
+	std::vector<int> a(n);
+	std::vector<int> b(n);
+	for (int i = 0; i < n; i++) {
+		a[i] = random() % (2 * n);
+		b[i] = random() % (2 * n);
+	}
+
+	std::vector<int> threadCounts = { 1 };
+	int hardwareThreads = (int)std::thread::hardware_concurrency();
+	if (hardwareThreads > 1) { // Otherwise the second column would repeat the first
+		threadCounts.push_back(hardwareThreads);
+	}
+
+	std::cout << "   Operation    insert-based";
+	for (int threads : threadCounts) {
+		std::cout << std::setw(16) << ("join " + std::to_string(threads) + (threads == 1 ? " thread" : " threads"));
+	}
+	std::cout << "  (ms)" << std::endl;
+
+	benchmarkOperation("union", a, b, threadCounts,
+		[](Treap<int>& first, Treap<int>& second) { second.forEach([&](int key) { first.insert(key); }); },
+		[](Treap<int>& first, Treap<int>& second, int threads) { first.unionWith(second, threads); });
+
+	benchmarkOperation("intersection", a, b, threadCounts,
+		[](Treap<int>& first, Treap<int>& second) {
+			Treap<int> common;
+			first.forEach([&](int key) {
+				if (second.search(key) != nullptr) {
+					common.insert(key);
+				}
+			});
+			first = std::move(common);
+		},
+		[](Treap<int>& first, Treap<int>& second, int threads) { first.intersectWith(second, threads); });
+
+	benchmarkOperation("difference", a, b, threadCounts,
+		[](Treap<int>& first, Treap<int>& second) { second.forEach([&](int key) { first.erase(key); }); },
+		[](Treap<int>& first, Treap<int>& second, int threads) { first.difference(second, threads); });
+}
+
+int main()
+{
+	Treap<int> treap;
+
+	for (int i = 1; i <= 10; i++) { // Sorted keys, still O(log n) deep
+		treap.insert(i);
+	}
+
+	Treap<int> upper = treap.split(6);
+	treap.display(); // 1 2 3 4 5
+	upper.display(); // 6 7 8 9 10
+
+	treap.join(upper);
+	treap.erase(5);
+	treap.display(); // 1 2 3 4 6 7 8 9 10
+
+	Treap<int> odd;
+	for (int i = 1; i <= 15; i += 2) {
+		odd.insert(i);
+	}
+
+	treap.intersectWith(odd);
+	treap.display(); // 1 3 7 9
+
+	benchmark(500000);
+
+	return 0;
+}